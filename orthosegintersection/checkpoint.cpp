@@ -0,0 +1,143 @@
+#include "checkpoint.h"
+#include <algorithm>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+using namespace std;
+
+
+#define CP_MAGIC "OSICHKPT"
+#define CP_VERSION 1
+
+/* Header of a saved checkpoint, followed by the active segments */
+typedef struct _cpHeader {
+  char magic[8];
+  uint32_t version;
+  int32_t eventIndex;
+  int32_t sweepX;
+  uint32_t nbActive;
+  uint64_t nbIntersections;
+  uint64_t checksum;
+} cpHeader;
+
+
+/* **************************************** */
+void cp_init(checkpointLog* log, int every, size_t keep) {
+    assert(every > 0);
+    log->every = every;
+    log->keep = keep;
+    log->last = -1;
+    log->cps.clear();
+}
+
+
+/* **************************************** */
+int cp_due(const checkpointLog* log, int eventIndex) {
+    if (log->last < 0) return 1;
+    return eventIndex - log->last >= log->every;
+}
+
+
+/* **************************************** */
+void cp_skip(checkpointLog* log, int eventIndex) {
+    log->last = eventIndex;
+}
+
+
+/* **************************************** */
+void cp_record(checkpointLog* log, const sweepCheckpoint& cp) {
+    assert(log->cps.empty() || cp.eventIndex > log->cps.back().eventIndex);
+    if (log->keep > 0 && log->cps.size() >= log->keep) {
+        log->cps.erase(log->cps.begin(), log->cps.end() - (log->keep - 1));
+    }
+    log->cps.push_back(cp);
+    log->last = cp.eventIndex;
+}
+
+
+/* **************************************** */
+const sweepCheckpoint* cp_before(const checkpointLog* log, int x) {
+    //the first checkpoint past x
+    vector<sweepCheckpoint>::const_iterator it =
+        upper_bound(log->cps.begin(), log->cps.end(), x,
+                    [](int x, const sweepCheckpoint& cp) { return x < cp.sweepX; });
+    if (it == log->cps.begin()) return NULL;
+    return &*(it - 1);
+}
+
+
+/* **************************************** */
+uint64_t cp_events_checksum(const vector<event>& events) {
+    //FNV-1a over what defines the sweep
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < events.size(); i++) {
+        int v[6] = {events[i].eventType, events[i].eventXCoord, events[i].segmentId,
+                    events[i].segment.start.y, events[i].segment.end.x, events[i].segment.end.y};
+        const unsigned char* p = (const unsigned char*)v;
+        for (size_t j = 0; j < sizeof(v); j++) {
+            h = (h ^ p[j]) * 1099511628211ULL;
+        }
+    }
+    return h;
+}
+
+
+/* **************************************** */
+int cp_save(const sweepCheckpoint* cp, uint64_t checksum, const char* path) {
+    cpHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CP_MAGIC, sizeof(h.magic));
+    h.version = CP_VERSION;
+    h.eventIndex = cp->eventIndex;
+    h.sweepX = cp->sweepX;
+    h.nbActive = cp->active.size();
+    h.nbIntersections = cp->nbIntersections;
+    h.checksum = checksum;
+
+    //write next to path and rename, so that an interruption leaves the previous checkpoint
+    string tmp = string(path) + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (f == NULL) {
+        perror(tmp.c_str());
+        return -1;
+    }
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1
+        && (cp->active.empty()
+            || fwrite(&cp->active[0], sizeof(segment2D), cp->active.size(), f) == cp->active.size());
+    if (fclose(f) != 0 || !ok || rename(tmp.c_str(), path) != 0) {
+        perror(path);
+        remove(tmp.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+
+/* **************************************** */
+int cp_load(sweepCheckpoint* cp, uint64_t checksum, const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        return -1;
+    }
+    cpHeader h;
+    int r = -1;
+    if (fread(&h, sizeof(h), 1, f) == 1
+        && memcmp(h.magic, CP_MAGIC, sizeof(h.magic)) == 0
+        && h.version == CP_VERSION && h.checksum == checksum) {
+        cp->eventIndex = h.eventIndex;
+        cp->sweepX = h.sweepX;
+        cp->nbIntersections = h.nbIntersections;
+        cp->active.resize(h.nbActive);
+        if (h.nbActive == 0
+            || fread(&cp->active[0], sizeof(segment2D), h.nbActive, f) == h.nbActive) {
+            r = 0;
+        }
+    }
+    if (r != 0) {
+        fprintf(stderr, "%s: not a checkpoint of this input, ignored\n", path);
+    }
+    fclose(f);
+    return r;
+}
@@ -0,0 +1,72 @@
+#ifndef __checkpoint_h
+#define __checkpoint_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "geom.h"
+
+
+/* Snapshots of the sweep, taken every so many events, so that the
+   sweep can be restarted from any of them instead of from the first
+   event: the viewer uses them to jump to any x and to go backwards,
+   and a batch run saves the last one to resume after an interruption.
+
+   A snapshot is taken between two values of the sweep line, when the
+   events up to eventIndex have all been handled. Restoring it and
+   replaying at most `every` events gives the state at any later x.
+ */
+
+typedef struct _sweepCheckpoint {
+  int eventIndex; /* first event not yet handled */
+  int sweepX; /* position of the sweep line */
+  uint64_t nbIntersections; /* intersections found so far */
+  std::vector<segment2D> active; /* the active structure */
+} sweepCheckpoint;
+
+
+typedef struct _checkpointLog {
+  int every; /* events between two checkpoints */
+  size_t keep; /* checkpoints kept, the last ones; 0 for all */
+  int last; /* eventIndex of the last checkpoint taken or skipped, -1 if none */
+  std::vector<sweepCheckpoint> cps; /* by increasing eventIndex */
+} checkpointLog;
+
+
+/* empties log and sets the spacing of its checkpoints and how many of
+   them it keeps: the viewer keeps them all to jump anywhere, a batch
+   run only needs the last one */
+void cp_init(checkpointLog* log, int every, size_t keep = 0);
+
+/* returns 1 if a sweep that has handled the events up to eventIndex
+   is due for a new checkpoint, i.e. every events past the last one
+   taken or skipped */
+int cp_due(const checkpointLog* log, int eventIndex);
+
+/* passes on the checkpoint due at eventIndex, so that the next one is
+   due every events later: a batch run only snapshots the sweep when it
+   is going to save the snapshot */
+void cp_skip(checkpointLog* log, int eventIndex);
+
+/* appends cp, which must be past the last checkpoint, dropping the
+   oldest one if the log is full */
+void cp_record(checkpointLog* log, const sweepCheckpoint& cp);
+
+/* returns the last checkpoint whose sweep line is at or before x, or
+   NULL if there is none */
+const sweepCheckpoint* cp_before(const checkpointLog* log, int x);
+
+
+/* a checksum of the events, stored with a saved checkpoint so that it
+   is only restored over the same input */
+uint64_t cp_events_checksum(const std::vector<event>& events);
+
+/* writes cp to path, replacing it atomically. Returns 0 on success,
+   -1 on failure */
+int cp_save(const sweepCheckpoint* cp, uint64_t checksum, const char* path);
+
+/* reads the checkpoint saved in path. Returns 0 on success, -1 if
+   there is no valid checkpoint for events with this checksum */
+int cp_load(sweepCheckpoint* cp, uint64_t checksum, const char* path);
+
+#endif
@@ -0,0 +1,433 @@
+#include "colstore.h"
+#include <algorithm>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+
+/* A segment as the columns describe it */
+typedef struct _csSeg {
+  int x, kind, fixed, id;
+  uint32_t extent; /* may not fit an int for far apart endpoints */
+} csSeg;
+
+static csSeg cs_describe(const segment2D& s, int id) {
+    csSeg c;
+    c.id = id;
+    if (s.start.x != s.end.x) {
+        c.kind = 0;
+        c.x = min(s.start.x, s.end.x);
+        c.fixed = s.start.y;
+        c.extent = (uint32_t)max(s.start.x, s.end.x) - (uint32_t)c.x;
+    } else {
+        c.kind = 1;
+        c.x = s.start.x;
+        c.fixed = min(s.start.y, s.end.y);
+        c.extent = (uint32_t)max(s.start.y, s.end.y) - (uint32_t)c.fixed;
+    }
+    return c;
+}
+
+
+/* Bits needed for values up to v */
+static int bit_width(uint32_t v) {
+    return v ? 32 - __builtin_clz(v) : 0;
+}
+
+static void put_varint(vector<uint8_t>* out, uint32_t v) {
+    while (v >= 0x80) {
+        out->push_back((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    out->push_back(v);
+}
+
+/* Reads a varint that ends before end; a corrupt one is cut short there */
+static uint32_t get_varint(const uint8_t** p, const uint8_t* end) {
+    uint32_t v = 0;
+    for (int shift = 0; *p < end && shift < 32; shift += 7) {
+        uint8_t b = *(*p)++;
+        v |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) break;
+    }
+    return v;
+}
+
+/* Bytes of n values packed in width bits */
+static size_t packed_size(size_t n, int width) {
+    return (n * width + 7) / 8;
+}
+
+/* Appends the n values v(i) in width bits each, least significant first */
+template <class V>
+static void put_packed(vector<uint8_t>* out, size_t n, int width, V v) {
+    uint64_t acc = 0;
+    int bits = 0;
+    for (size_t i = 0; i < n; i++) {
+        acc |= (uint64_t)v(i) << bits;
+        bits += width;
+        while (bits >= 8) {
+            out->push_back(acc & 0xff);
+            acc >>= 8;
+            bits -= 8;
+        }
+    }
+    if (bits > 0) out->push_back(acc & 0xff);
+}
+
+/* Reads back n values of width bits with f(i, value) */
+template <class F>
+static const uint8_t* get_packed(const uint8_t* p, size_t n, int width, F f) {
+    uint64_t acc = 0;
+    int bits = 0;
+    uint32_t mask = width == 32 ? 0xffffffffu : (1u << width) - 1;
+    for (size_t i = 0; i < n; i++) {
+        while (bits < width) {
+            acc |= (uint64_t)*p++ << bits;
+            bits += 8;
+        }
+        f(i, (uint32_t)acc & mask);
+        acc >>= width;
+        bits -= width;
+    }
+    return p;
+}
+
+
+/* Encode the segments cs[first, last), all of the same kind, as one block */
+static void cs_encode_block(const vector<csSeg>& cs, size_t first, size_t last,
+                            csBlock* b, vector<uint8_t>* out) {
+    size_t n = last - first;
+    memset(b, 0, sizeof(csBlock));
+    b->count = n;
+    b->kind = cs[first].kind;
+    b->minX = cs[first].x;
+    b->maxX = cs[first].x;
+    int maxFixed = cs[first].fixed, maxId = cs[first].id;
+    uint32_t maxExtent = 0;
+    b->baseFixed = cs[first].fixed;
+    b->baseId = cs[first].id;
+    for (size_t i = first; i < last; i++) {
+        b->maxX = max(b->maxX, cs[i].kind ? cs[i].x : (int)((uint32_t)cs[i].x + cs[i].extent));
+        b->baseFixed = min(b->baseFixed, cs[i].fixed);
+        maxFixed = max(maxFixed, cs[i].fixed);
+        b->baseId = min(b->baseId, cs[i].id);
+        maxId = max(maxId, cs[i].id);
+        maxExtent = max(maxExtent, cs[i].extent);
+    }
+    b->widthFixed = bit_width((uint32_t)maxFixed - (uint32_t)b->baseFixed);
+    b->widthExtent = bit_width(maxExtent);
+    b->widthId = bit_width((uint32_t)maxId - (uint32_t)b->baseId);
+
+    size_t start = out->size();
+    int prev = b->minX;
+    for (size_t i = first; i < last; i++) {
+        put_varint(out, (uint32_t)cs[i].x - (uint32_t)prev);
+        prev = cs[i].x;
+    }
+    put_packed(out, n, b->widthFixed,
+               [&](size_t i) { return (uint32_t)cs[first + i].fixed - (uint32_t)b->baseFixed; });
+    put_packed(out, n, b->widthExtent, [&](size_t i) { return cs[first + i].extent; });
+    put_packed(out, n, b->widthId,
+               [&](size_t i) { return (uint32_t)cs[first + i].id - (uint32_t)b->baseId; });
+    b->size = out->size() - start;
+}
+
+
+/* **************************************** */
+size_t cs_save(const vector<segment2D>& segments, const char* path, int blockSize) {
+    assert(blockSize > 0);
+    vector<csSeg> hs, vs;
+    csHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CS_MAGIC, sizeof(h.magic));
+    h.version = CS_VERSION;
+    h.blockSize = blockSize;
+    h.nbSegments = segments.size();
+    for (size_t i = 0; i < segments.size(); i++) {
+        csSeg c = cs_describe(segments[i], (int)i);
+        (c.kind ? vs : hs).push_back(c);
+        int y1 = min(segments[i].start.y, segments[i].end.y);
+        int y2 = max(segments[i].start.y, segments[i].end.y);
+        h.minY = i ? min(h.minY, y1) : y1;
+        h.maxY = i ? max(h.maxY, y2) : y2;
+    }
+    vector<uint8_t> data;
+    vector<csBlock> blocks;
+    //the run of the horizontals, then that of the verticals
+    for (int kind = 0; kind < 2; kind++) {
+        vector<csSeg>& cs = kind ? vs : hs;
+        sort(cs.begin(), cs.end(), [](const csSeg& a, const csSeg& b) {
+            if (a.x != b.x) return a.x < b.x;
+            return a.id < b.id;
+        });
+        for (size_t first = 0; first < cs.size(); first += blockSize) {
+            csBlock b;
+            cs_encode_block(cs, first, min(cs.size(), first + blockSize), &b, &data);
+            b.offset = sizeof(csHeader) + data.size() - b.size;
+            blocks.push_back(b);
+            data.resize((data.size() + 7) & ~(size_t)7, 0);
+        }
+        if (kind == 0) h.nbHorizontalBlocks = blocks.size();
+    }
+    h.nbBlocks = blocks.size();
+    h.indexOffset = sizeof(csHeader) + data.size();
+    h.fileSize = h.indexOffset + blocks.size() * sizeof(csBlock);
+
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) {
+        perror(path);
+        return 0;
+    }
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1
+        && (data.empty() || fwrite(&data[0], 1, data.size(), f) == data.size())
+        && (blocks.empty() || fwrite(&blocks[0], sizeof(csBlock), blocks.size(), f) == blocks.size());
+    if (fclose(f) != 0 || !ok) {
+        perror(path);
+        return 0;
+    }
+    return h.fileSize;
+}
+
+
+/* Error message if a block of the index lies outside the data, holds
+   more than blockSize segments or is too small for them, starts out
+   of the y-range of the file, or the runs are out of order, else NULL */
+static const char* cs_check_blocks(const csHeader* h, const csBlock* blocks) {
+    if (h->blockSize == 0 || h->nbHorizontalBlocks > h->nbBlocks
+        || (h->nbSegments > 0 && h->minY > h->maxY)) {
+        return "corrupt column file header";
+    }
+    uint64_t nbSegments = 0;
+    for (uint64_t b = 0; b < h->nbBlocks; b++) {
+        const csBlock& blk = blocks[b];
+        if (blk.offset < sizeof(csHeader) || blk.offset > h->indexOffset
+            || blk.size > h->indexOffset - blk.offset) {
+            return "column block out of the file";
+        }
+        //every x takes at least a byte, and the packed columns their exact size
+        if (blk.count == 0 || blk.count > h->blockSize
+            || blk.widthFixed > 32 || blk.widthExtent > 32 || blk.widthId > 32
+            || blk.kind != (b >= h->nbHorizontalBlocks)
+            || blk.baseFixed < h->minY || blk.baseFixed > h->maxY
+            || blk.size < blk.count + packed_size(blk.count, blk.widthFixed)
+                          + packed_size(blk.count, blk.widthExtent)
+                          + packed_size(blk.count, blk.widthId)) {
+            return "corrupt column block";
+        }
+        if (b > 0 && b != h->nbHorizontalBlocks && blk.minX < blocks[b - 1].minX) {
+            return "column blocks out of order";
+        }
+        nbSegments += blk.count;
+    }
+    if (nbSegments != h->nbSegments) {
+        return "corrupt column file header";
+    }
+    return NULL;
+}
+
+
+/* **************************************** */
+int cs_open(csFile* cs, const char* path) {
+    memset(cs, 0, sizeof(csFile));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(csHeader)) {
+        fprintf(stderr, "%s: not a column file\n", path);
+        close(fd);
+        return -1;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(path);
+        return -1;
+    }
+
+    const csHeader* h = (const csHeader*)map;
+    const char* error = NULL;
+    if (memcmp(h->magic, CS_MAGIC, sizeof(h->magic)) != 0) {
+        error = "not a column file";
+    } else if (h->version != CS_VERSION) {
+        error = "unsupported column file version";
+    } else if (h->fileSize > (uint64_t)st.st_size || h->indexOffset > h->fileSize
+               || h->indexOffset < sizeof(csHeader)
+               || h->nbBlocks > (h->fileSize - h->indexOffset) / sizeof(csBlock)) {
+        error = "truncated column file";
+    } else {
+        error = cs_check_blocks(h, (const csBlock*)((const char*)map + h->indexOffset));
+    }
+    if (error != NULL) {
+        fprintf(stderr, "%s: %s\n", path, error);
+        munmap(map, st.st_size);
+        return -1;
+    }
+    cs->map = map;
+    cs->mapSize = st.st_size;
+    cs->header = h;
+    cs->blocks = (const csBlock*)((const char*)map + h->indexOffset);
+    return 0;
+}
+
+
+/* **************************************** */
+void cs_close(csFile* cs) {
+    if (cs->map != NULL) {
+        munmap(cs->map, cs->mapSize);
+    }
+    memset(cs, 0, sizeof(csFile));
+}
+
+
+/* **************************************** */
+void cs_decode_block(const csFile* cs, size_t b, vector<segment2D>* segs, vector<int>* ids) {
+    const csBlock& blk = cs->blocks[b];
+    size_t n = blk.count;
+    const uint8_t* p = (const uint8_t*)cs->map + blk.offset;
+    //the x end where the packed columns start (checked by cs_open)
+    const uint8_t* xEnd = p + blk.size - packed_size(n, blk.widthFixed)
+        - packed_size(n, blk.widthExtent) - packed_size(n, blk.widthId);
+    segs->resize(n);
+    ids->resize(n);
+    segment2D* s = n ? &(*segs)[0] : NULL;
+    int* id = n ? &(*ids)[0] : NULL;
+
+    //x, then fixed and extent turn it into a segment of the kind of the block
+    uint32_t x = blk.minX;
+    for (size_t i = 0; i < n; i++) {
+        x += get_varint(&p, xEnd);
+        s[i].start.x = s[i].end.x = (int)x;
+    }
+    p = get_packed(p, n, blk.widthFixed, [&](size_t i, uint32_t v) {
+        s[i].start.y = s[i].end.y = (int)(v + (uint32_t)blk.baseFixed);
+    });
+    p = get_packed(p, n, blk.widthExtent, [&](size_t i, uint32_t v) {
+        if (blk.kind) {
+            s[i].end.y = (int)((uint32_t)s[i].end.y + v);
+        } else {
+            s[i].end.x = (int)((uint32_t)s[i].end.x + v);
+        }
+    });
+    get_packed(p, n, blk.widthId, [&](size_t i, uint32_t v) { id[i] = (int)(v + (uint32_t)blk.baseId); });
+
+    //the sweep sizes its active structure from the y-range of the
+    //header, which a corrupt block could otherwise step out of
+    int minY = cs->header->minY, maxY = cs->header->maxY;
+    for (size_t i = 0; i < n; i++) {
+        s[i].start.y = min(max(s[i].start.y, minY), maxY);
+        s[i].end.y = min(max(s[i].end.y, s[i].start.y), maxY);
+    }
+}
+
+
+/* **************************************** */
+void cs_stream_init(csStream* st, const csFile* cs, int x1, int x2) {
+    st->cs = cs;
+    st->x1 = x1;
+    st->x2 = x2;
+    csCursor* runs[2] = {&st->horizontals, &st->verticals};
+    for (int kind = 0; kind < 2; kind++) {
+        csCursor* c = runs[kind];
+        c->block = kind ? cs->header->nbHorizontalBlocks : 0;
+        c->end = kind ? cs->header->nbBlocks : cs->header->nbHorizontalBlocks;
+        c->segs.clear();
+        c->ids.clear();
+        c->pos = 0;
+    }
+    st->ends = priority_queue<event, vector<event>, csLaterEnd>();
+    st->blocksRead = st->blocksSkipped = 0;
+}
+
+
+/* The next segment of run c that touches [x1, x2], decoding blocks as
+   needed, or NULL at the end of the run */
+static const segment2D* cs_cursor_peek(csStream* st, csCursor* c, int* id) {
+    for (;;) {
+        for (; c->pos < c->segs.size(); c->pos++) {
+            const segment2D& s = c->segs[c->pos];
+            if (s.start.x > st->x2) {
+                //sorted by x, so nothing further touches the range
+                st->blocksSkipped += c->end - c->block;
+                c->block = c->end;
+                c->segs.clear();
+                return NULL;
+            }
+            if (s.end.x >= st->x1) {
+                *id = c->ids[c->pos];
+                return &s;
+            }
+        }
+        //the next block that overlaps the range
+        const csBlock* blocks = st->cs->blocks;
+        while (c->block < c->end && blocks[c->block].maxX < st->x1) {
+            c->block++;
+            st->blocksSkipped++;
+        }
+        if (c->block == c->end || blocks[c->block].minX > st->x2) {
+            st->blocksSkipped += c->end - c->block;
+            c->block = c->end;
+            return NULL;
+        }
+        cs_decode_block(st->cs, c->block++, &c->segs, &c->ids);
+        st->blocksRead++;
+        c->pos = 0;
+    }
+}
+
+
+/* **************************************** */
+size_t cs_stream_read(csStream* st, event* events, size_t max) {
+    size_t k = 0;
+    while (k < max) {
+        int hid, vid;
+        const segment2D* h = cs_cursor_peek(st, &st->horizontals, &hid);
+        const segment2D* v = cs_cursor_peek(st, &st->verticals, &vid);
+        bool haveEnd = !st->ends.empty();
+        int endX = haveEnd ? st->ends.top().eventXCoord : 0;
+
+        //at the same x the starts come first, then the verticals, then the ends
+        event e;
+        memset(&e, 0, sizeof(e));
+        if (h != NULL && (v == NULL || h->start.x <= v->start.x)
+            && (!haveEnd || h->start.x <= endX)) {
+            st->horizontals.pos++;
+            e.segment = *h;
+            e.segmentId = hid;
+            e.eventType = 'S';
+            e.eventXCoord = h->start.x;
+            events[k++] = e;
+            e.eventType = 'E';
+            e.eventXCoord = h->end.x;
+            st->ends.push(e);
+        } else if (v != NULL && (!haveEnd || v->start.x <= endX)) {
+            st->verticals.pos++;
+            e.segment = *v;
+            e.segmentId = vid;
+            e.eventType = 'V';
+            e.eventXCoord = v->start.x;
+            events[k++] = e;
+        } else if (haveEnd) {
+            events[k++] = st->ends.top();
+            st->ends.pop();
+        } else {
+            break;
+        }
+    }
+    return k;
+}
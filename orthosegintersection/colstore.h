@@ -0,0 +1,139 @@
+#ifndef __colstore_h
+#define __colstore_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <queue>
+#include <vector>
+#include "geom.h"
+
+
+/* A compressed, columnar file of segments that the sweep reads
+   directly, block by block, instead of an array of 16-byte segment2D.
+
+   The horizontals and the verticals are kept apart, each sorted by
+   their smallest x (then by id) and cut into blocks of blockSize, so
+   that a block only holds one kind of segment. Every segment is
+   described by
+
+   x       its smallest x
+   fixed   the coordinate it does not vary in besides x: the y of a
+           horizontal, the lower y of a vertical
+   extent  its length: x2 - x1 or y2 - y1
+   id      its position in the input
+
+   and a block stores each of these as a column: the x as varint
+   deltas from the previous one (they are sorted), and fixed, extent
+   and id bit-packed to the width of their range in the block (frame
+   of reference). For the random segments this is 5 to 6 bytes per
+   segment instead of 16.
+
+   The index of the blocks at the end of the file has the blocks of
+   the horizontals, then those of the verticals, each run in order of
+   x, and gives the range of x each block covers, from the smallest x
+   of its first segment to the largest x of any of its segments. A
+   sweep restricted to [x1, x2] reads only the blocks that overlap it:
+   a run stops at its first block that starts past x2, and as the
+   verticals have no extent in x, their blocks cover disjoint ranges
+   and the ones left of x1 are skipped as well, however long the
+   horizontals are.
+
+   The file is mapped with mmap, and cs_stream_read decodes the blocks
+   of both runs one at a time and merges them into events in the order
+   of the sweep (event_before), holding back the end of each
+   horizontal until the sweep reaches it.
+
+   Layout:
+
+   csHeader
+   block data, each block starting on 8 bytes
+   csBlock   blocks[nbBlocks]      at indexOffset, the nbHorizontalBlocks
+                                   of the horizontals first
+ */
+
+#define CS_MAGIC "OSICOLMN"
+#define CS_VERSION 2
+#define CS_BLOCK_SIZE 4096
+
+typedef struct _csHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t blockSize;
+  uint64_t nbSegments;
+  uint64_t nbBlocks;
+  uint64_t nbHorizontalBlocks;
+  int32_t minY, maxY; /* range of y of all the segments */
+  uint64_t indexOffset;
+  uint64_t fileSize;
+} csHeader;
+
+typedef struct _csBlock {
+  int32_t minX; /* smallest x in the block, that of its first segment */
+  int32_t maxX; /* largest x of any segment in the block */
+  uint32_t count;
+  uint32_t size; /* bytes of data */
+  uint64_t offset; /* of the data in the file */
+  int32_t baseFixed, baseId; /* subtracted before packing */
+  uint8_t widthFixed, widthExtent, widthId; /* bits per value */
+  uint8_t kind; /* of all its segments: 0 for horizontals, 1 for verticals */
+  uint8_t unused[4];
+} csBlock;
+
+
+typedef struct _csFile {
+  void* map;
+  size_t mapSize;
+  const csHeader* header;
+  const csBlock* blocks;
+} csFile;
+
+
+/* writes segments to path in blocks of blockSize. Returns the size of
+   the file, or 0 on failure */
+size_t cs_save(const std::vector<segment2D>& segments, const char* path, int blockSize);
+
+/* maps the file in path and checks its header and the bounds of every
+   block. Returns 0 on success, -1 on failure */
+int cs_open(csFile* cs, const char* path);
+void cs_close(csFile* cs);
+
+/* replaces segs and ids with the segments of block b, normalized so
+   that start has the smaller coordinates and clamped to the y-range of
+   the header */
+void cs_decode_block(const csFile* cs, size_t b, std::vector<segment2D>* segs,
+                     std::vector<int>* ids);
+
+
+/* Greater x first, for a min-heap of the pending end events */
+struct csLaterEnd {
+  bool operator()(const event& a, const event& b) const { return a.eventXCoord > b.eventXCoord; }
+};
+
+/* Where the stream is in one run of blocks */
+typedef struct _csCursor {
+  size_t block, end; /* next block to decode, and the end of the run */
+  std::vector<segment2D> segs; /* the block being read */
+  std::vector<int> ids;
+  size_t pos; /* next segment of it */
+} csCursor;
+
+/* The events of a file, or of the part of it that touches [x1, x2] */
+typedef struct _csStream {
+  const csFile* cs;
+  int x1, x2;
+  csCursor horizontals, verticals;
+  std::priority_queue<event, std::vector<event>, csLaterEnd> ends;
+  size_t blocksRead, blocksSkipped;
+} csStream;
+
+
+/* starts the events of the segments of cs that touch [x1, x2]; only
+   the verticals inside it are returned, and the horizontals that
+   cross it */
+void cs_stream_init(csStream* st, const csFile* cs, int x1, int x2);
+
+/* writes up to max next events to events, sorted by event_before.
+   Returns how many, 0 at the end */
+size_t cs_stream_read(csStream* st, event* events, size_t max);
+
+#endif
@@ -0,0 +1,213 @@
+#include "concbench.h"
+#include "concindex.h"
+#include "liveindex.h"
+#include "rtimer.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <stdio.h>
+#include <thread>
+
+using namespace std;
+
+
+/* The box the segments lie in, where the queries and insertions are drawn */
+typedef struct _benchBox {
+  int x1, x2, y1, y2;
+} benchBox;
+
+static segment2D random_segment(const benchBox& b, mt19937& rng) {
+    segment2D s;
+    s.start.x = b.x1 + rng() % (b.x2 - b.x1 + 1);
+    s.start.y = b.y1 + rng() % (b.y2 - b.y1 + 1);
+    s.end = s.start;
+    if (rng() % 2) {
+        s.end.x = b.x1 + rng() % (b.x2 - b.x1 + 1);
+    } else {
+        s.end.y = b.y1 + rng() % (b.y2 - b.y1 + 1);
+    }
+    return s;
+}
+
+
+/* What the threads of one run share */
+typedef struct _benchRun {
+  atomic<bool> stop;
+  atomic<long> nbWrites;
+  atomic<long> nbPublishes;
+  vector<vector<double> > latencies; /* per reader */
+} benchRun;
+
+
+/* The reader and writer loops of a run, given how to read and how to
+   update; the writer starts with the nbSegments indexed segments live
+   and calls update once every updateUsec microseconds, or back to back
+   if it falls behind */
+template <class Read, class Update>
+static void bench(benchRun* run, const benchBox& box, size_t nbSegments, int nbReaders,
+                  double seconds, double updateUsec, Read read, Update update) {
+    run->stop.store(false);
+    run->nbWrites.store(0);
+    run->nbPublishes.store(0);
+    run->latencies.assign(nbReaders, vector<double>());
+
+    vector<thread> threads;
+    for (int r = 0; r < nbReaders; r++) {
+        threads.push_back(thread([=, &box]() {
+            mt19937 rng(r + 1);
+            vector<int> out;
+            vector<double>& lat = run->latencies[r];
+            lat.reserve(1 << 20);
+            while (!run->stop.load(memory_order_relaxed)) {
+                segment2D v = random_segment(box, rng);
+                int y1 = min(v.start.y, v.end.y), y2 = max(v.start.y, v.end.y);
+                out.clear();
+                double t = rt_now_usec();
+                read(r, v.start.x, y1, y2, &out);
+                lat.push_back(rt_now_usec() - t);
+            }
+        }));
+    }
+    threads.push_back(thread([=, &box]() {
+        mt19937 rng(0);
+        vector<int> live(nbSegments);
+        for (size_t i = 0; i < nbSegments; i++) live[i] = (int)i;
+        double start = rt_now_usec();
+        for (long u = 0; !run->stop.load(memory_order_relaxed); u++) {
+            //on a schedule, so that both runs see the same write load
+            double wait = start + u * updateUsec - rt_now_usec();
+            if (wait > 0) {
+                this_thread::sleep_for(chrono::microseconds((long)wait));
+            }
+            update(rng, &live);
+        }
+    }));
+
+    double end = rt_now_usec() + seconds * 1e6;
+    while (rt_now_usec() < end) {
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    run->stop.store(true);
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+}
+
+
+static void print_run(const char* name, const benchRun* run, double seconds) {
+    vector<double> all;
+    for (size_t r = 0; r < run->latencies.size(); r++) {
+        all.insert(all.end(), run->latencies[r].begin(), run->latencies[r].end());
+    }
+    sort(all.begin(), all.end());
+    const double* p = all.data();
+    size_t n = all.size();
+    printf("%-6s reads=%.0f/s writes=%.0f/s publishes=%.0f/s p50=%.1fus p90=%.1fus p99=%.1fus p999=%.1fus max=%.0fus\n",
+           name, all.size() / seconds, run->nbWrites.load() / seconds, run->nbPublishes.load() / seconds,
+           rt_percentile(p, n, 0.5), rt_percentile(p, n, 0.9), rt_percentile(p, n, 0.99),
+           rt_percentile(p, n, 0.999), n ? p[n - 1] : 0.0);
+}
+
+
+/* **************************************** */
+int run_concurrent_bench(const vector<segment2D>& segments, int nbReaders,
+                         double seconds, int writesPerPublish, int writesPerSecond) {
+    benchBox box = {0, 1, 0, 1};
+    for (size_t i = 0; i < segments.size(); i++) {
+        const segment2D& s = segments[i];
+        if (i == 0) {
+            box.x1 = box.x2 = s.start.x;
+            box.y1 = box.y2 = s.start.y;
+        }
+        box.x1 = min(box.x1, min(s.start.x, s.end.x));
+        box.x2 = max(box.x2, max(s.start.x, s.end.x));
+        box.y1 = min(box.y1, min(s.start.y, s.end.y));
+        box.y2 = max(box.y2, max(s.start.y, s.end.y));
+    }
+    benchRun run;
+    double updateUsec = 1e6 * writesPerPublish / writesPerSecond;
+    printf("%d readers, 1 writer at %d updates/s, %d updates per publish, %.1fs per run\n",
+           nbReaders, writesPerSecond, writesPerPublish, seconds);
+
+    //A liveIndex behind one lock: an update, or a rebuild, holds up every reader
+    {
+        liveIndex lx;
+        if (lx_init_segments(&lx, segments) != 0) {
+            return -1;
+        }
+        mutex lock;
+        bench(&run, box, segments.size(), nbReaders, seconds, updateUsec,
+              [&](int r, int x, int y1, int y2, vector<int>* out) {
+                  lock_guard<mutex> g(lock);
+                  lx_report(&lx, x, y1, y2, out);
+              },
+              [&](mt19937& rng, vector<int>* live) {
+                  lock_guard<mutex> g(lock);
+                  for (int w = 0; w < writesPerPublish; w++) {
+                      //as many deletions as insertions, so that n stays
+                      //put, of indexed and inserted segments alike
+                      if (live->empty() || rng() % 2) {
+                          live->push_back(lx_insert(&lx, random_segment(box, rng)));
+                      } else {
+                          size_t i = rng() % live->size();
+                          lx_delete(&lx, (*live)[i]);
+                          (*live)[i] = live->back();
+                          live->pop_back();
+                      }
+                  }
+                  lx_maybe_rebuild(&lx);
+                  run.nbWrites += writesPerPublish;
+                  run.nbPublishes++;
+              });
+        print_run("mutex", &run, seconds);
+        printf("%zu rebuilds\n", lx.nbRebuilds);
+        lx_close(&lx);
+    }
+
+    //The same load against snapshots
+    {
+        cxIndex* cx = new cxIndex;
+        if (cx_init(cx, segments) != 0) {
+            delete cx;
+            return -1;
+        }
+        vector<int> slots(nbReaders);
+        for (int r = 0; r < nbReaders; r++) {
+            slots[r] = cx_register(cx);
+            if (slots[r] < 0) {
+                fprintf(stderr, "at most %d readers\n", CX_MAX_READERS);
+                return -1;
+            }
+        }
+        bench(&run, box, segments.size(), nbReaders, seconds, updateUsec,
+              [&](int r, int x, int y1, int y2, vector<int>* out) {
+                  const cxSnapshot* snap = cx_pin(cx, slots[r]);
+                  cx_report(snap, x, y1, y2, out);
+                  cx_unpin(cx, slots[r]);
+              },
+              [&](mt19937& rng, vector<int>* live) {
+                  for (int w = 0; w < writesPerPublish; w++) {
+                      if (live->empty() || rng() % 2) {
+                          live->push_back(cx_insert(cx, random_segment(box, rng)));
+                      } else {
+                          size_t i = rng() % live->size();
+                          cx_delete(cx, (*live)[i]);
+                          (*live)[i] = live->back();
+                          live->pop_back();
+                      }
+                  }
+                  cx_publish(cx);
+                  run.nbWrites += writesPerPublish;
+                  run.nbPublishes++;
+              });
+        print_run("rcu", &run, seconds);
+        printf("%zu rebuilds, %zu snapshots not yet reclaimed\n", cx->nbRebuilds, cx->retired.size());
+        for (int r = 0; r < nbReaders; r++) {
+            cx_unregister(cx, slots[r]);
+        }
+        cx_close(cx);
+        delete cx;
+    }
+    return 0;
+}
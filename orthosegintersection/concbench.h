@@ -0,0 +1,26 @@
+#ifndef __concbench_h
+#define __concbench_h
+
+#include <vector>
+#include "geom.h"
+
+
+/* Measures the latency of reads against a live index of segments while
+   a writer keeps inserting and deleting, first with a liveIndex behind
+   a mutex, then with the lock-free cxIndex (see concindex.h).
+
+   nbReaders threads run report queries on random verticals for the
+   given number of seconds, timing each one, while one writer thread
+   alternately inserts random segments and deletes random live ones,
+   indexed or inserted, publishing (or releasing the lock) every
+   writesPerPublish updates. The writer is paced to writesPerSecond
+   updates, so both indexes see the same updates at the same rate and
+   rebuild at the same sizes; the printed write rate falls short of it
+   only if an index cannot keep up. Prints the throughput, the p50,
+   p90, p99 and p999 read latencies and the number of rebuilds of both
+   runs. Returns 0 on success, -1 if an index cannot be built.
+ */
+int run_concurrent_bench(const std::vector<segment2D>& segments, int nbReaders,
+                         double seconds, int writesPerPublish, int writesPerSecond);
+
+#endif
@@ -0,0 +1,267 @@
+#include "concindex.h"
+#include "liveindex.h"
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+using namespace std;
+
+
+/* Index the live segments of the writer in a new static index, or return NULL */
+static segIndex* cx_build_base(const cxIndex* cx) {
+    vector<event> events;
+    create_events(cx->segments, &cx->alive, &events);
+    sort(events.begin(), events.end(), event_before);
+    segIndex* base = new segIndex;
+    if (si_build(base, events, cx->segments, &cx->alive) != 0) {
+        delete base;
+        return NULL;
+    }
+    return base;
+}
+
+
+/* **************************************** */
+int cx_init(cxIndex* cx, const vector<segment2D>& segments) {
+    cx->segments.resize(segments.size());
+    for (size_t i = 0; i < segments.size(); i++) {
+        cx->segments[i] = normalize_segment(segments[i]);
+    }
+    cx->alive.assign(segments.size(), 1);
+    cx->inBase = cx->alive;
+    cx->next = NULL;
+    cx->retired.clear();
+    cx->retiredBases.clear();
+    cx->nbRebuilds = 0;
+    for (int r = 0; r < CX_MAX_READERS; r++) {
+        cx->slots[r].epoch.store(0);
+        cx->slots[r].used.store(0);
+    }
+    cx->epoch.store(1);
+
+    cxSnapshot* snap = new cxSnapshot;
+    snap->version = 1;
+    snap->nbAlive = segments.size();
+    snap->base = cx_build_base(cx);
+    if (snap->base == NULL) {
+        delete snap;
+        cx->current.store(NULL);
+        return -1;
+    }
+    cx->current.store(snap);
+    return 0;
+}
+
+
+/* Free the retired snapshots and indexes that no pinned reader can see */
+static void cx_reclaim(cxIndex* cx) {
+    uint64_t oldest = UINT64_MAX;
+    for (int r = 0; r < CX_MAX_READERS; r++) {
+        uint64_t e = cx->slots[r].epoch.load();
+        if (e != 0 && e < oldest) oldest = e;
+    }
+    size_t j = 0;
+    for (size_t i = 0; i < cx->retired.size(); i++) {
+        if (cx->retired[i].first < oldest) {
+            delete cx->retired[i].second;
+        } else {
+            cx->retired[j++] = cx->retired[i];
+        }
+    }
+    cx->retired.resize(j);
+    j = 0;
+    for (size_t i = 0; i < cx->retiredBases.size(); i++) {
+        if (cx->retiredBases[i].first < oldest) {
+            si_close(cx->retiredBases[i].second);
+            delete cx->retiredBases[i].second;
+        } else {
+            cx->retiredBases[j++] = cx->retiredBases[i];
+        }
+    }
+    cx->retiredBases.resize(j);
+}
+
+
+/* **************************************** */
+void cx_close(cxIndex* cx) {
+    for (int r = 0; r < CX_MAX_READERS; r++) {
+        assert(!cx->slots[r].used.load());
+    }
+    cxSnapshot* snap = cx->current.load();
+    if (snap != NULL) {
+        //the staged snapshot shares its base with the current one
+        si_close(snap->base);
+        delete snap->base;
+        delete snap;
+    }
+    delete cx->next;
+    cx->next = NULL;
+    cx->current.store(NULL);
+    cx_reclaim(cx);
+    assert(cx->retired.empty() && cx->retiredBases.empty());
+}
+
+
+/* **************************************** */
+int cx_register(cxIndex* cx) {
+    for (int r = 0; r < CX_MAX_READERS; r++) {
+        int unused = 0;
+        if (cx->slots[r].used.compare_exchange_strong(unused, 1)) {
+            cx->slots[r].epoch.store(0);
+            return r;
+        }
+    }
+    return -1;
+}
+
+
+/* **************************************** */
+void cx_unregister(cxIndex* cx, int slot) {
+    cx->slots[slot].epoch.store(0);
+    cx->slots[slot].used.store(0);
+}
+
+
+/* **************************************** */
+const cxSnapshot* cx_pin(cxIndex* cx, int slot) {
+    //announce the epoch before looking at the snapshot, so that the
+    //writer cannot free it once it has seen the announcement
+    cx->slots[slot].epoch.store(cx->epoch.load());
+    return cx->current.load();
+}
+
+
+/* **************************************** */
+void cx_unpin(cxIndex* cx, int slot) {
+    cx->slots[slot].epoch.store(0, memory_order_release);
+}
+
+
+/* **************************************** */
+size_t cx_report(const cxSnapshot* snap, int x, int y1, int y2, vector<int>* out) {
+    if (y1 > y2) swap(y1, y2);
+    size_t first = out->size();
+
+    si_report(snap->base, x, y1, y2, out);
+    if (!snap->removed.empty()) {
+        //drop the deleted ones
+        size_t j = first;
+        for (size_t i = first; i < out->size(); i++) {
+            if (!binary_search(snap->removed.begin(), snap->removed.end(), (*out)[i])) {
+                (*out)[j++] = (*out)[i];
+            }
+        }
+        out->resize(j);
+    }
+    for (size_t i = 0; i < snap->added.size(); i++) {
+        if (crosses_vertical(snap->addedSegments[i], x, y1, y2)) {
+            out->push_back(snap->added[i]);
+        }
+    }
+    return out->size() - first;
+}
+
+
+/* **************************************** */
+size_t cx_count(const cxSnapshot* snap, int x, int y1, int y2) {
+    if (y1 > y2) swap(y1, y2);
+
+    size_t k = si_count(snap->base, x, y1, y2);
+    for (size_t i = 0; i < snap->removedSegments.size(); i++) {
+        if (crosses_vertical(snap->removedSegments[i], x, y1, y2)) k--;
+    }
+    for (size_t i = 0; i < snap->addedSegments.size(); i++) {
+        if (crosses_vertical(snap->addedSegments[i], x, y1, y2)) k++;
+    }
+    return k;
+}
+
+
+/* The snapshot the writer stages its updates in, copied from the current one */
+static cxSnapshot* cx_staged(cxIndex* cx) {
+    if (cx->next == NULL) {
+        cx->next = new cxSnapshot(*cx->current.load());
+    }
+    return cx->next;
+}
+
+
+/* **************************************** */
+int cx_insert(cxIndex* cx, segment2D s) {
+    cxSnapshot* next = cx_staged(cx);
+    int id = (int)cx->segments.size();
+    s = normalize_segment(s);
+    cx->segments.push_back(s);
+    cx->alive.push_back(1);
+    cx->inBase.push_back(0);
+    next->added.push_back(id);
+    next->addedSegments.push_back(s);
+    next->nbAlive++;
+    return id;
+}
+
+
+/* **************************************** */
+int cx_delete(cxIndex* cx, int id) {
+    if (id < 0 || id >= (int)cx->segments.size() || !cx->alive[id]) {
+        return -1;
+    }
+    cxSnapshot* next = cx_staged(cx);
+    cx->alive[id] = 0;
+    next->nbAlive--;
+    if (cx->inBase[id]) {
+        vector<int>::iterator it = lower_bound(next->removed.begin(), next->removed.end(), id);
+        next->removedSegments.insert(next->removedSegments.begin() + (it - next->removed.begin()),
+                                     cx->segments[id]);
+        next->removed.insert(it, id);
+    } else {
+        size_t i = find(next->added.begin(), next->added.end(), id) - next->added.begin();
+        assert(i < next->added.size());
+        next->added.erase(next->added.begin() + i);
+        next->addedSegments.erase(next->addedSegments.begin() + i);
+    }
+    return 0;
+}
+
+
+/* **************************************** */
+uint64_t cx_publish(cxIndex* cx) {
+    cxSnapshot* next = cx->next;
+    cxSnapshot* old = cx->current.load();
+    if (next == NULL) {
+        return old->version;
+    }
+    cx->next = NULL;
+    next->version = old->version + 1;
+
+    segIndex* oldBase = NULL;
+    size_t delta = next->added.size() + next->removed.size();
+    size_t limit = max((size_t)LX_MIN_DELTA, (size_t)sqrt((double)next->nbAlive));
+    if (delta > limit) {
+        segIndex* base = cx_build_base(cx);
+        //if the rebuild fails, keep answering from the side lists
+        if (base != NULL) {
+            oldBase = next->base;
+            next->base = base;
+            next->added.clear();
+            next->addedSegments.clear();
+            next->removed.clear();
+            next->removedSegments.clear();
+            cx->inBase = cx->alive;
+            cx->nbRebuilds++;
+        }
+    }
+
+    //readers that pin from now on get next; the ones that may hold old
+    //announced an epoch no later than e
+    cx->current.store(next);
+    uint64_t e = cx->epoch.load();
+    cx->retired.push_back(make_pair(e, old));
+    if (oldBase != NULL) {
+        cx->retiredBases.push_back(make_pair(e, oldBase));
+    }
+    cx->epoch.store(e + 1);
+    cx_reclaim(cx);
+    return next->version;
+}
@@ -0,0 +1,112 @@
+#ifndef __concindex_h
+#define __concindex_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include "geom.h"
+#include "segindex.h"
+
+
+/* A live index of segments that any number of threads can query while
+   one writer thread inserts and deletes, without the readers ever
+   taking a lock or waiting on the writer.
+
+   The readers only see immutable snapshots. A snapshot is a static
+   segIndex, shared by the snapshots until the next rebuild, plus the
+   segments inserted and the indexed segments deleted since then, as in
+   liveindex.h. The writer stages its updates in a private copy of the
+   side lists and publishes it as the next version with one atomic
+   store; a rebuild is done by the writer on the side and published the
+   same way, so a slow rebuild never stalls a query.
+
+   Old snapshots, and old static indexes, are reclaimed by epochs. A
+   reader pins a snapshot by announcing the global epoch in its slot
+   and then loading the current snapshot; a snapshot replaced during
+   epoch e is freed once every slot is idle or past e, since a reader
+   that announced a later epoch can only have loaded a newer snapshot.
+   Pinning is two atomic operations and never retries.
+
+   There must be a single writer at a time. Segment ids are positions
+   in the writer's list of segments and are never reused.
+ */
+
+#define CX_MAX_READERS 64
+
+
+typedef struct _cxSnapshot {
+  uint64_t version; /* 1 for the first snapshot, then one more per publish */
+  segIndex* base; /* static index over the segments live at the last rebuild */
+  std::vector<int> added; /* live ids inserted since the last rebuild */
+  std::vector<segment2D> addedSegments; /* their segments */
+  std::vector<int> removed; /* sorted ids of base deleted since the last rebuild */
+  std::vector<segment2D> removedSegments; /* their segments */
+  size_t nbAlive;
+} cxSnapshot;
+
+
+/* One reader's announcement, alone on its cache line */
+typedef struct _cxSlot {
+  std::atomic<uint64_t> epoch; /* 0 if idle, else the epoch it pinned at */
+  std::atomic<int> used;
+  char pad[64 - sizeof(std::atomic<uint64_t>) - sizeof(std::atomic<int>)];
+} cxSlot;
+
+
+typedef struct _cxIndex {
+  std::atomic<cxSnapshot*> current;
+  std::atomic<uint64_t> epoch;
+  cxSlot slots[CX_MAX_READERS];
+
+  /* the writer's own state */
+  std::vector<segment2D> segments; /* every segment ever inserted, by id */
+  std::vector<char> alive;
+  std::vector<char> inBase;
+  cxSnapshot* next; /* the staged updates, or NULL if there are none */
+  std::vector<std::pair<uint64_t, cxSnapshot*> > retired; /* with the epoch they were replaced in */
+  std::vector<std::pair<uint64_t, segIndex*> > retiredBases;
+  size_t nbRebuilds;
+} cxIndex;
+
+
+/* builds the index over segments and publishes it as version 1.
+   Returns 0 on success, -1 on failure */
+int cx_init(cxIndex* cx, const std::vector<segment2D>& segments);
+
+/* frees everything; no reader may be registered */
+void cx_close(cxIndex* cx);
+
+
+/* claims a reader slot for the calling thread. Returns it, or -1 if
+   there are CX_MAX_READERS readers already */
+int cx_register(cxIndex* cx);
+void cx_unregister(cxIndex* cx, int slot);
+
+/* returns the current snapshot, which stays valid until cx_unpin */
+const cxSnapshot* cx_pin(cxIndex* cx, int slot);
+void cx_unpin(cxIndex* cx, int slot);
+
+/* appends to out the ids of the horizontals of snap that intersect
+   the vertical segment x=x, y1<=y<=y2; returns how many */
+size_t cx_report(const cxSnapshot* snap, int x, int y1, int y2, std::vector<int>* out);
+
+/* returns the number of horizontals of snap that intersect the
+   vertical segment x=x, y1<=y<=y2 */
+size_t cx_count(const cxSnapshot* snap, int x, int y1, int y2);
+
+
+/* stages the insertion of s and returns its id (writer only) */
+int cx_insert(cxIndex* cx, segment2D s);
+
+/* stages the deletion of segment id. Returns 0 on success, -1 if
+   there is no such live segment (writer only) */
+int cx_delete(cxIndex* cx, int id);
+
+/* publishes the staged updates as the next version, rebuilding the
+   static index first if the side lists have grown past
+   max(LX_MIN_DELTA, sqrt(n)), and frees what no reader can still see.
+   Returns the version now current (writer only) */
+uint64_t cx_publish(cxIndex* cx);
+
+#endif
@@ -0,0 +1,426 @@
+#include "daemon.h"
+#include "rtimer.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+
+
+/* number of latencies kept for the percentiles */
+#define DM_LATENCY_WINDOW 65536
+
+/* bytes read from a client at a time */
+#define DM_READ_SIZE 65536
+
+/* answers a client may leave unread before it is dropped */
+#define DM_MAX_PENDING (64 << 20)
+
+/* requests taken from one client per batch; the rest wait for the next */
+#define DM_MAX_LINES 256
+
+/* how often the loop looks for a finished background rebuild, in milliseconds */
+#define DM_REBUILD_POLL_MSEC 10
+
+
+typedef struct _client {
+    int in, out; /* the same socket, or stdin and stdout */
+    string inbuf; /* bytes read but not yet taken as requests */
+    double since; /* when the oldest complete line of inbuf was read, in microseconds */
+    string outbuf; /* answers not yet written */
+    bool eof; /* nothing more to read */
+    bool closed;
+} client;
+
+typedef struct _request {
+    int client;
+    string line;
+    double arrival; /* microseconds */
+    string answer;
+} request;
+
+typedef struct _daemonStats {
+    vector<double> latencies; /* ring of the last DM_LATENCY_WINDOW latencies */
+    size_t nbRequests;
+    size_t nbBatches;
+    size_t maxBatch;
+} daemonStats;
+
+/* one vertical of a report request */
+typedef struct _reportQuery {
+    int x, y1, y2;
+    size_t request;
+    size_t slot;
+} reportQuery;
+
+
+/* Parses the integers after the command word of line; returns 0 if
+   anything else is found */
+static bool parse_ints(const string& line, vector<long>* v) {
+    const char* p = line.c_str();
+    while (*p && *p != ' ') p++;
+    for (;;) {
+        while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+        if (!*p) return true;
+        char* end;
+        errno = 0;
+        long x = strtol(p, &end, 10);
+        if (end == p || errno) return false;
+        v->push_back(x);
+        p = end;
+    }
+}
+
+/* The command word of line */
+static string command(const string& line) {
+    size_t i = line.find(' ');
+    string c = line.substr(0, i);
+    if (!c.empty() && c[c.size() - 1] == '\r') c.erase(c.size() - 1);
+    return c;
+}
+
+static bool is_read(const string& line) {
+    string c = command(line);
+    return c == "report" || c == "count";
+}
+
+
+static string format_stats(const liveIndex* lx, const daemonStats* st) {
+    vector<double> sorted(st->latencies);
+    sort(sorted.begin(), sorted.end());
+    const double* p = sorted.data();
+    size_t n = sorted.size();
+    char buf[512];
+    sprintf(buf, "ok segments=%d added=%d removed=%d rebuilds=%d requests=%d batches=%d "
+            "avgbatch=%.1f maxbatch=%d p50=%.0fus p90=%.0fus p99=%.0fus p999=%.0fus max=%.0fus",
+            (int)lx->nbAlive, (int)lx->added.size(), (int)lx->removed.size(),
+            (int)lx->nbRebuilds, (int)st->nbRequests, (int)st->nbBatches,
+            st->nbBatches ? (double)st->nbRequests / st->nbBatches : 0.0, (int)st->maxBatch,
+            rt_percentile(p, n, 0.5), rt_percentile(p, n, 0.9), rt_percentile(p, n, 0.99),
+            rt_percentile(p, n, 0.999), n ? p[n - 1] : 0.0);
+    return buf;
+}
+
+
+/* Answers the reads batch[first..last), the report verticals all together in order of x */
+static void answer_reads(const liveIndex* lx, vector<request>& batch, size_t first, size_t last) {
+    vector<reportQuery> queries;
+    vector<vector<string> > pieces(last - first);
+
+    for (size_t r = first; r < last; r++) {
+        vector<long> v;
+        string c = command(batch[r].line);
+        if (!parse_ints(batch[r].line, &v)) {
+            batch[r].answer = "error bad number";
+        } else if (c == "count") {
+            if (v.size() != 4) {
+                batch[r].answer = "error usage: count x1 x2 y1 y2";
+                continue;
+            }
+            if (!lx->windowCounter) {
+                batch[r].answer = "error the index has no window counter";
+                continue;
+            }
+            char buf[64];
+            sprintf(buf, "ok %lu", (unsigned long)lx_count_window(lx, v[0], v[1], v[2], v[3]));
+            batch[r].answer = buf;
+        } else {
+            if (v.empty() || v.size() % 3 != 0) {
+                batch[r].answer = "error usage: report x y1 y2 [x y1 y2 ...]";
+                continue;
+            }
+            pieces[r - first].resize(v.size() / 3);
+            for (size_t q = 0; q < v.size(); q += 3) {
+                reportQuery rq = {(int)v[q], (int)v[q + 1], (int)v[q + 2], r, q / 3};
+                queries.push_back(rq);
+            }
+        }
+    }
+
+    //Neighbouring x share most of their path in the tree
+    sort(queries.begin(), queries.end(),
+         [](const reportQuery& a, const reportQuery& b) { return a.x < b.x; });
+    vector<int> ids;
+    for (size_t q = 0; q < queries.size(); q++) {
+        const reportQuery& rq = queries[q];
+        ids.clear();
+        lx_report(lx, rq.x, rq.y1, rq.y2, &ids);
+        string& s = pieces[rq.request - first][rq.slot];
+        char buf[16];
+        sprintf(buf, "%d", (int)ids.size());
+        s = buf;
+        for (size_t i = 0; i < ids.size(); i++) {
+            sprintf(buf, " %d", ids[i]);
+            s += buf;
+        }
+    }
+    for (size_t r = first; r < last; r++) {
+        if (pieces[r - first].empty()) continue;
+        batch[r].answer = "ok ";
+        for (size_t i = 0; i < pieces[r - first].size(); i++) {
+            if (i) batch[r].answer += "; ";
+            batch[r].answer += pieces[r - first][i];
+        }
+    }
+}
+
+
+/* Answers one update or control request; returns true on shutdown */
+static bool answer_write(liveIndex* lx, const daemonStats* st, request& req) {
+    vector<long> v;
+    string c = command(req.line);
+    char buf[64];
+
+    if (c == "stats") {
+        req.answer = format_stats(lx, st);
+    } else if (c == "shutdown") {
+        req.answer = "ok";
+        return true;
+    } else if (!parse_ints(req.line, &v)) {
+        req.answer = "error bad number";
+    } else if (c == "insert") {
+        if (v.size() != 4 || (v[0] != v[2] && v[1] != v[3])) {
+            req.answer = "error usage: insert x1 y1 x2 y2 (horizontal or vertical)";
+        } else {
+            segment2D s;
+            s.start.x = v[0]; s.start.y = v[1];
+            s.end.x = v[2]; s.end.y = v[3];
+            sprintf(buf, "ok %d", lx_insert(lx, s));
+            req.answer = buf;
+        }
+    } else if (c == "delete") {
+        if (v.size() != 1) {
+            req.answer = "error usage: delete id";
+        } else if (lx_delete(lx, (int)v[0]) != 0) {
+            req.answer = "error no segment " + to_string(v[0]);
+        } else {
+            req.answer = "ok";
+        }
+    } else {
+        req.answer = "error unknown request " + c;
+    }
+    return false;
+}
+
+
+/* Writes as much of buf to fd as it takes without blocking and
+   removes it from buf; returns false if the client went away */
+static bool write_some(int fd, string* buf) {
+    size_t done = 0;
+    while (done < buf->size()) {
+        ssize_t w = write(fd, buf->data() + done, buf->size() - done);
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (w <= 0) return false;
+        done += w;
+    }
+    buf->erase(0, done);
+    return true;
+}
+
+
+/* Reads what client c has sent into its inbuf; returns false on end of input */
+static bool read_client(client* c) {
+    char buf[DM_READ_SIZE];
+    ssize_t r = read(c->in, buf, sizeof(buf));
+    if (r < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+    if (r <= 0) return false;
+
+    //lines still waiting from an earlier read keep their arrival time
+    if (c->inbuf.find('\n') == string::npos) c->since = rt_now_usec();
+    c->inbuf.append(buf, r);
+    return true;
+}
+
+/* Moves at most DM_MAX_LINES complete lines of client c to batch; returns
+   true if it has more */
+static bool take_lines(vector<client>& clients, int c, vector<request>& batch) {
+    string& in = clients[c].inbuf;
+    size_t start = 0, nl;
+    int taken = 0;
+    while (taken < DM_MAX_LINES && (nl = in.find('\n', start)) != string::npos) {
+        request req;
+        req.client = c;
+        req.line = in.substr(start, nl - start);
+        req.arrival = clients[c].since;
+        if (!req.line.empty()) {
+            batch.push_back(req);
+            taken++;
+        }
+        start = nl + 1;
+    }
+    in.erase(0, start);
+    return in.find('\n') != string::npos;
+}
+
+
+/* Opens a listening Unix domain socket at path */
+static int listen_on(const char* path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 64) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+/* **************************************** */
+int run_daemon(liveIndex* lx, const char* socketPath) {
+
+    bool useStdin = strcmp(socketPath, "-") == 0;
+    int listenFd = -1;
+    vector<client> clients;
+    daemonStats st;
+    st.nbRequests = st.nbBatches = st.maxBatch = 0;
+
+    signal(SIGPIPE, SIG_IGN);
+    if (useStdin) {
+        client c = {0, 1, "", 0, "", false, false};
+        clients.push_back(c);
+    } else {
+        listenFd = listen_on(socketPath);
+        if (listenFd < 0) return -1;
+        fprintf(stderr, "listening on %s\n", socketPath);
+    }
+
+    bool done = false;
+    bool more = false; //requests already read wait for the next batch
+    while (!done) {
+        //Wait for requests, new clients, or room for the answers a client
+        //has not taken yet; a client with a full inbuf is not read from
+        vector<struct pollfd> fds;
+        for (size_t c = 0; c < clients.size(); c++) {
+            struct pollfd p = {clients[c].in, 0, 0};
+            if (!clients[c].eof && clients[c].inbuf.size() < DM_READ_SIZE) p.events |= POLLIN;
+            if (!clients[c].outbuf.empty()) p.events |= POLLOUT;
+            if (p.events == 0) p.fd = -1;
+            fds.push_back(p);
+        }
+        size_t nbPolled = clients.size();
+        if (listenFd >= 0) {
+            struct pollfd p = {listenFd, POLLIN, 0};
+            fds.push_back(p);
+        }
+        int timeout = more ? 0 : (lx->rebuild != NULL ? DM_REBUILD_POLL_MSEC : -1);
+        if (poll(&fds[0], fds.size(), timeout) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+        if (listenFd >= 0 && (fds.back().revents & POLLIN)) {
+            int fd = accept(listenFd, NULL, NULL);
+            //a client that does not read its answers must not block the others
+            if (fd >= 0 && fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+                perror("fcntl");
+                close(fd);
+                fd = -1;
+            }
+            if (fd >= 0) {
+                client c = {fd, fd, "", 0, "", false, false};
+                clients.push_back(c);
+            }
+        }
+
+        //What is waiting makes up the batch, up to DM_MAX_LINES requests
+        //per client so that one burst does not hold up the others; the
+        //clients accepted above were not polled yet
+        vector<request> batch;
+        more = false;
+        for (size_t c = 0; c < nbPolled; c++) {
+            if ((fds[c].events & POLLIN) && (fds[c].revents & (POLLIN | POLLHUP | POLLERR))) {
+                if (!read_client(&clients[c])) clients[c].eof = true;
+            }
+            if (take_lines(clients, c, batch)) {
+                more = true;
+            } else if (clients[c].eof) {
+                //its last requests are in this batch
+                clients[c].closed = true;
+                if (useStdin) done = true;
+            }
+        }
+
+        //Reads between two updates are answered together
+        size_t i = 0;
+        while (i < batch.size()) {
+            size_t j = i;
+            while (j < batch.size() && is_read(batch[j].line)) j++;
+            answer_reads(lx, batch, i, j);
+            for (; j < batch.size() && !is_read(batch[j].line); j++) {
+                if (answer_write(lx, &st, batch[j])) done = true;
+            }
+            i = j;
+        }
+        //the rebuild runs in the background and is swapped in between batches
+        lx_finish_rebuild(lx, false);
+        lx_start_rebuild(lx);
+
+        //One write per client, of what its socket takes now, then account the latencies
+        for (size_t r = 0; r < batch.size(); r++) {
+            clients[batch[r].client].outbuf += batch[r].answer + "\n";
+        }
+        for (size_t c = 0; c < clients.size(); c++) {
+            if (!clients[c].outbuf.empty() && !write_some(clients[c].out, &clients[c].outbuf)) {
+                clients[c].closed = true;
+            }
+            if (clients[c].outbuf.size() > DM_MAX_PENDING) {
+                fprintf(stderr, "dropping a client that does not read its answers\n");
+                clients[c].closed = true;
+            }
+        }
+        double t = rt_now_usec();
+        for (size_t r = 0; r < batch.size(); r++) {
+            if (st.latencies.size() < DM_LATENCY_WINDOW) {
+                st.latencies.push_back(t - batch[r].arrival);
+            } else {
+                st.latencies[st.nbRequests % DM_LATENCY_WINDOW] = t - batch[r].arrival;
+            }
+            st.nbRequests++;
+        }
+        if (!batch.empty()) {
+            st.nbBatches++;
+            st.maxBatch = max(st.maxBatch, batch.size());
+        }
+
+        //Drop the clients that went away
+        for (size_t c = clients.size(); c-- > 0; ) {
+            if (clients[c].closed && !useStdin) {
+                close(clients[c].in);
+                clients.erase(clients.begin() + c);
+            }
+        }
+    }
+
+    for (size_t c = 0; c < clients.size() && !useStdin; c++) {
+        close(clients[c].in);
+    }
+    if (listenFd >= 0) {
+        close(listenFd);
+        unlink(socketPath);
+    }
+    return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef __daemon_h
+#define __daemon_h
+
+#include "liveindex.h"
+
+
+/* Serves queries against lx until told to shut down.
+
+   If socketPath is "-" the requests are read from stdin and the
+   answers written to stdout; otherwise the daemon listens on a Unix
+   domain socket at socketPath and serves any number of clients at
+   once. Requests and answers are one line each:
+
+   report x y1 y2 [x y1 y2 ...]   ok <k> <id>...[; <k> <id>...]...
+                                  the horizontals crossed by each vertical
+   count x1 x2 y1 y2              ok <k>
+                                  intersections in the window [x1,x2]x[y1,y2]
+   insert x1 y1 x2 y2             ok <id>
+   delete id                      ok
+   stats                          ok segments=... p50=...us p99=...us ...
+   shutdown                       ok, and the daemon exits
+
+   and a malformed or failed request is answered with "error <why>".
+
+   The complete lines that are waiting, up to 256 per client, are
+   answered as one batch: updates are applied in arrival order, the
+   reads in between are answered in order of x, and each client gets
+   its answers in a single write. The static index is rebuilt in a
+   background thread and swapped in between two batches, so a rebuild
+   never holds up the requests.
+   Client sockets do not block: what a client does not read right away
+   is kept and written when its socket has room, and a client that
+   leaves more than 64 MB of answers unread is dropped. The latency of
+   a request is measured from when its line is read to when its answer
+   is handed to the socket.
+
+   Returns 0 after a shutdown request or the end of stdin, -1 if the
+   socket cannot be set up.
+ */
+int run_daemon(liveIndex* lx, const char* socketPath);
+
+#endif
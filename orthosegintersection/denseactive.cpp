@@ -0,0 +1,137 @@
+#include "denseactive.h"
+#include <algorithm>
+#include <assert.h>
+
+using namespace std;
+
+
+/* **************************************** */
+void hb_init(hierBitmap* b, size_t size) {
+    b->levels.clear();
+    do {
+        size = (size + 63) / 64;
+        b->levels.push_back(vector<uint64_t>(size, 0));
+    } while (size > 1);
+}
+
+
+/* **************************************** */
+void hb_clear(hierBitmap* b) {
+    for (size_t l = 0; l < b->levels.size(); l++) {
+        fill(b->levels[l].begin(), b->levels[l].end(), 0);
+    }
+}
+
+
+/* **************************************** */
+void hb_set(hierBitmap* b, size_t i) {
+    for (size_t l = 0; l < b->levels.size(); l++) {
+        uint64_t& w = b->levels[l][i >> 6];
+        bool wasEmpty = w == 0;
+        w |= 1ULL << (i & 63);
+        if (!wasEmpty) return;
+        i >>= 6;
+    }
+}
+
+
+/* **************************************** */
+void hb_reset(hierBitmap* b, size_t i) {
+    for (size_t l = 0; l < b->levels.size(); l++) {
+        uint64_t& w = b->levels[l][i >> 6];
+        w &= ~(1ULL << (i & 63));
+        if (w != 0) return;
+        i >>= 6;
+    }
+}
+
+
+/* **************************************** */
+long hb_next(const hierBitmap* b, size_t i) {
+    //go up until a word has a set bit at or after i
+    size_t l = 0;
+    for (;; l++) {
+        if (l == b->levels.size()) return -1;
+        const vector<uint64_t>& level = b->levels[l];
+        if ((i >> 6) >= level.size()) return -1;
+        uint64_t bits = level[i >> 6] & (~0ULL << (i & 63));
+        if (bits) {
+            i = (i & ~(size_t)63) + __builtin_ctzll(bits);
+            break;
+        }
+        i = (i >> 6) + 1;
+    }
+    //then down along the first set bits
+    while (l > 0) {
+        l--;
+        i = (i << 6) + __builtin_ctzll(b->levels[l][i]);
+    }
+    return (long)i;
+}
+
+
+/* **************************************** */
+void da_init(denseActive* da, int ymin, int ymax) {
+    assert(ymin <= ymax);
+    da->ymin = ymin;
+    da->ymax = ymax;
+    size_t universe = (size_t)ymax - ymin + 1;
+    da->counter.assign(universe, 0);
+    hb_init(&da->occupied, universe);
+    hb_init(&da->multi, universe);
+    da->size = 0;
+}
+
+
+/* **************************************** */
+void da_clear(denseActive* da) {
+    fill(da->counter.begin(), da->counter.end(), 0);
+    hb_clear(&da->occupied);
+    hb_clear(&da->multi);
+    da->size = 0;
+}
+
+
+/* **************************************** */
+void da_insert(denseActive* da, int y) {
+    assert(da->ymin <= y && y <= da->ymax);
+    size_t i = y - da->ymin;
+    uint32_t c = ++da->counter[i];
+    if (c == 1) hb_set(&da->occupied, i);
+    else if (c == 2) hb_set(&da->multi, i);
+    da->size++;
+}
+
+
+/* **************************************** */
+void da_erase(denseActive* da, int y) {
+    assert(da->ymin <= y && y <= da->ymax);
+    size_t i = y - da->ymin;
+    assert(da->counter[i] > 0);
+    uint32_t c = --da->counter[i];
+    if (c == 0) hb_reset(&da->occupied, i);
+    else if (c == 1) hb_reset(&da->multi, i);
+    da->size--;
+}
+
+
+/* **************************************** */
+size_t da_count(const denseActive* da, int lo, int hi) {
+    if (lo < da->ymin) lo = da->ymin;
+    if (hi > da->ymax) hi = da->ymax;
+    if (lo > hi || da->size == 0) return 0;
+    size_t first = lo - da->ymin, last = hi - da->ymin;
+
+    size_t k = 0;
+    hb_for_words(&da->occupied, first, last, [&](size_t w, uint64_t bits) {
+        k += __builtin_popcountll(bits);
+    });
+    //the heights shared by several horizontals were counted once
+    hb_for_words(&da->multi, first, last, [&](size_t w, uint64_t bits) {
+        while (bits) {
+            k += da->counter[(w << 6) + __builtin_ctzll(bits)] - 1;
+            bits &= bits - 1;
+        }
+    });
+    return k;
+}
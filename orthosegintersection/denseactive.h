@@ -0,0 +1,105 @@
+#ifndef __denseactive_h
+#define __denseactive_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+
+/* An active structure for the y-coordinates of the horizontal segments
+   when they all lie in a small range [ymin, ymax], such as the
+   WINDOWSIZE grid of the random segments.
+
+   Every y has a counter of the active horizontals at that height, and
+   a hierarchical bitmap marks the occupied ones: bit y of level 0 is
+   set if counter[y] > 0, bit i of level l+1 if word i of level l is
+   non-zero, up to a level of a single word. Insert and erase touch one
+   counter and, when a word changes between zero and non-zero, one bit
+   per level, so they take O(log_64 U) = O(1) time for any practical
+   universe U; there is no rebalancing and no allocation.
+
+   A range report walks the non-empty words of level 0, found through
+   the upper levels, and peels their bits with count-trailing-zeros.
+   A range count adds up the popcounts of those words, then corrects
+   for the heights with more than one horizontal, which a second bitmap
+   marks.
+ */
+
+/* largest y-range for which the dense structure is used */
+#define DENSE_MAX_UNIVERSE (1 << 22)
+
+
+/* A set of integers in [0, size) with next-set-bit queries */
+typedef struct _hierBitmap {
+  std::vector<std::vector<uint64_t> > levels; /* levels[0] has one bit per integer */
+} hierBitmap;
+
+void hb_init(hierBitmap* b, size_t size);
+void hb_clear(hierBitmap* b);
+void hb_set(hierBitmap* b, size_t i);
+void hb_reset(hierBitmap* b, size_t i);
+
+/* returns the smallest integer >= i in b, or -1 */
+long hb_next(const hierBitmap* b, size_t i);
+
+
+typedef struct _denseActive {
+  int ymin, ymax;
+  std::vector<uint32_t> counter; /* active horizontals at ymin + i */
+  hierBitmap occupied; /* counter[i] > 0 */
+  hierBitmap multi; /* counter[i] > 1 */
+  size_t size;
+} denseActive;
+
+
+/* prepares an empty structure for y in [ymin, ymax] */
+void da_init(denseActive* da, int ymin, int ymax);
+
+/* empties the structure */
+void da_clear(denseActive* da);
+
+/* adds, or removes, one horizontal at height y, which must be in range */
+void da_insert(denseActive* da, int y);
+void da_erase(denseActive* da, int y);
+
+/* returns the number of active horizontals with lo <= y <= hi */
+size_t da_count(const denseActive* da, int lo, int hi);
+
+
+/* calls f(word, bits) on the non-empty words of level 0 of b that
+   overlap [first, last], with the bits outside the range cleared */
+template <class F>
+void hb_for_words(const hierBitmap* b, size_t first, size_t last, F f) {
+    const std::vector<uint64_t>& words = b->levels[0];
+    for (long i = hb_next(b, first); i >= 0 && (size_t)i <= last; ) {
+        size_t w = i >> 6;
+        uint64_t bits = words[w] & (~0ULL << (i & 63));
+        if (w == last >> 6 && (last & 63) != 63) {
+            bits &= (1ULL << ((last & 63) + 1)) - 1;
+        }
+        f(w, bits);
+        if ((w + 1) << 6 > last) break;
+        i = hb_next(b, (w + 1) << 6);
+    }
+}
+
+
+/* calls f(y) for every active horizontal with lo <= y <= hi, in order of y */
+template <class F>
+void da_report(const denseActive* da, int lo, int hi, F f) {
+    if (lo < da->ymin) lo = da->ymin;
+    if (hi > da->ymax) hi = da->ymax;
+    if (lo > hi) return;
+
+    hb_for_words(&da->occupied, lo - da->ymin, hi - da->ymin, [&](size_t w, uint64_t bits) {
+        while (bits) {
+            size_t j = (w << 6) + __builtin_ctzll(bits);
+            for (uint32_t c = da->counter[j]; c > 0; c--) {
+                f((int)j + da->ymin);
+            }
+            bits &= bits - 1;
+        }
+    });
+}
+
+#endif
@@ -0,0 +1,107 @@
+#include "estimate.h"
+#include <algorithm>
+#include <math.h>
+#include <random>
+
+using namespace std;
+
+
+/* A horizontal segment, by y then x-range */
+typedef struct _hSeg {
+  int y, x1, x2;
+} hSeg;
+
+
+/* **************************************** */
+void est_intersections(const vector<segment2D>& segments, size_t nbSamples,
+                       size_t budget, double z, unsigned seed, kEstimate* est) {
+    vector<hSeg> hs;
+    vector<segment2D> vs;
+    for (size_t i = 0; i < segments.size(); i++) {
+        segment2D s = segments[i];
+        if (s.start.x != s.end.x) {
+            hSeg h = {s.start.y, min(s.start.x, s.end.x), max(s.start.x, s.end.x)};
+            hs.push_back(h);
+        } else {
+            if (s.start.y > s.end.y) swap(s.start, s.end);
+            vs.push_back(s);
+        }
+    }
+    sort(hs.begin(), hs.end(), [](const hSeg& a, const hSeg& b) { return a.y < b.y; });
+
+    est->nbHorizontals = hs.size();
+    est->nbVerticals = vs.size();
+    est->k = est->lo = est->hi = 0;
+    est->nbSamples = 0;
+    est->exact = 1;
+    if (hs.empty() || vs.empty()) {
+        return;
+    }
+    if (budget == 0) budget = 1;
+
+    //with fewer verticals than samples, count every one of them
+    bool census = nbSamples >= vs.size();
+    size_t m = census ? vs.size() : max(nbSamples, (size_t)2);
+    mt19937 rng(seed);
+
+    //sum and sum of squares of the sampled c(v), and the variance of
+    //the subsampled runs, which is all there is in a census
+    double sum = 0, sum2 = 0, runVar = 0;
+    for (size_t t = 0; t < m; t++) {
+        const segment2D& v = census ? vs[t] : vs[rng() % vs.size()];
+        int x = v.start.x;
+        size_t lo = lower_bound(hs.begin(), hs.end(), v.start.y,
+                                [](const hSeg& h, int y) { return h.y < y; }) - hs.begin();
+        size_t hi = upper_bound(hs.begin(), hs.end(), v.end.y,
+                                [](int y, const hSeg& h) { return y < h.y; }) - hs.begin();
+        size_t r = hi - lo;
+        double c;
+        if (r <= budget) {
+            size_t hits = 0;
+            for (size_t j = lo; j < hi; j++) {
+                hits += hs[j].x1 <= x && x <= hs[j].x2;
+            }
+            c = hits;
+        } else {
+            size_t hits = 0;
+            for (size_t j = 0; j < budget; j++) {
+                const hSeg& h = hs[lo + rng() % r];
+                hits += h.x1 <= x && x <= h.x2;
+            }
+            double p = (double)hits / budget;
+            c = p * r;
+            runVar += (double)r * r * p * (1 - p) / (budget - 1 > 0 ? budget - 1 : 1);
+            est->exact = 0;
+        }
+        sum += c;
+        sum2 += c * c;
+    }
+
+    double V = vs.size();
+    est->nbSamples = m;
+    est->k = V * sum / m;
+    double var;
+    if (census) {
+        var = runVar;
+    } else {
+        double mean = sum / m;
+        double s2 = max(0.0, (sum2 - m * mean * mean) / (m - 1));
+        var = V * V * s2 / m;
+        est->exact = 0;
+    }
+    double d = z * sqrt(var);
+    est->lo = max(0.0, est->k - d);
+    est->hi = est->k + d;
+}
+
+
+/* **************************************** */
+void est_print(FILE* f, const kEstimate* est) {
+    if (est->exact) {
+        fprintf(f, "k = %.0f (%zu horizontals, %zu verticals, all counted)\n",
+                est->k, est->nbHorizontals, est->nbVerticals);
+    } else {
+        fprintf(f, "k ~ %.0f in [%.0f, %.0f] (%zu horizontals, %zu verticals, %zu sampled)\n",
+                est->k, est->lo, est->hi, est->nbHorizontals, est->nbVerticals, est->nbSamples);
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef __estimate_h
+#define __estimate_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include "geom.h"
+
+
+/* Estimates k, the number of intersections, before sweeping, to size
+   the output and to decide whether it is worth keeping at all.
+
+   k is the sum over the verticals of c(v), the number of horizontals
+   that v crosses. The horizontals are sorted by y, so that those in
+   the y-range of v are a contiguous run of R of them, found by binary
+   search; c(v) is the number of that run whose x-range holds the x of
+   v. The estimator draws nbSamples verticals at random and counts c(v)
+   for each, exactly if R <= budget and otherwise from budget random
+   members of the run scaled by R / budget. Then
+
+   k ~ V * mean of the sampled c(v)
+
+   is unbiased, and the spread of the samples gives a normal confidence
+   interval of k. If there are no more verticals than samples, all of
+   them are counted, and k is exact unless some runs were subsampled.
+
+   The cost is O(n log n) for the sort and O(nbSamples * (log n +
+   budget)) for the samples, independent of k.
+ */
+
+#define EST_SAMPLES 2048
+#define EST_BUDGET 256
+
+
+typedef struct _kEstimate {
+  double k; /* the estimate of k */
+  double lo, hi; /* confidence interval of k */
+  size_t nbHorizontals, nbVerticals;
+  size_t nbSamples; /* verticals counted */
+  int exact; /* 1 if k is the exact number of intersections */
+} kEstimate;
+
+
+/* estimates the number of intersections between the horizontal and
+   the vertical segments of segments, with an interval of z standard
+   errors (z = 1.96 for 95%). seed makes the sample reproducible */
+void est_intersections(const std::vector<segment2D>& segments, size_t nbSamples,
+                       size_t budget, double z, unsigned seed, kEstimate* est);
+
+/* prints est on one line to f */
+void est_print(FILE* f, const kEstimate* est);
+
+#endif
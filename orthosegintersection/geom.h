@@ -3,6 +3,11 @@
 #ifndef __geom_h
 #define __geom_h
 
+/* geom.c may be compiled as C while the rest is C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 
 typedef struct _point2d {
   int x,y; 
@@ -14,11 +19,12 @@ typedef struct _segment2d {
   point2D end; 
 } segment2D;
 
-/*Event strut contains the type of the event, the eventXCoord of the event, and the segment associated with the event*/
+/*Event strut contains the type of the event, the eventXCoord of the event, the segment associated with the event and the id of that segment (its position in the input)*/
 typedef struct _event {
     char eventType;
     int eventXCoord ;
     struct _segment2d segment;
+    int segmentId;
 } event;
 
 
@@ -46,4 +52,51 @@ int collinear(point2D p, point2D q, point2D r);
 int left (point2D a, point2D b, point2D c); 
 
 
+/* return 1 if s1 and s2 intersect */
+int intersect(segment2D s1, segment2D s2);
+
+
+/* return 1 if s1 and s2 intersect at a point interior to both */
+int intersect_proper(segment2D s1, segment2D s2);
+
+
+/* return 1 if s1 and s2 intersect at an endpoint of one or both */
+int intersect_improper(segment2D s1, segment2D s2);
+
+
+/* return 1 if c is collinear with and between a and b */
+int between(point2D a, point2D b, point2D c);
+
+
+/* The segments of the sweep are horizontal or vertical. These are
+   inline so that the C++ modules share them whatever geom.c is
+   compiled as. */
+
+/* return 1 if s is horizontal, i.e. the sweep gives it a start and an end event */
+static inline int is_horizontal(segment2D s) {
+  return s.start.x != s.end.x;
+}
+
+/* return s with its endpoints swapped if needed so that start has the smaller coordinate */
+static inline segment2D normalize_segment(segment2D s) {
+  if (s.start.x > s.end.x || s.start.y > s.end.y) {
+    point2D p = s.start;
+    s.start = s.end;
+    s.end = p;
+  }
+  return s;
+}
+
+/* return 1 if s, normalized, is a horizontal crossing the vertical
+   segment x=x, y1<=y<=y2 (y1<=y2) */
+static inline int crosses_vertical(segment2D s, int x, int y1, int y2) {
+  return is_horizontal(s) && s.start.x <= x && x <= s.end.x
+    && y1 <= s.start.y && s.start.y <= y2;
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -0,0 +1,244 @@
+#include "join.h"
+#include <algorithm>
+#include <set>
+#include <string.h>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+
+/* A horizontal of A */
+typedef struct _redSeg {
+  int y, x1, x2, id;
+} redSeg;
+
+/* A vertical of B */
+typedef struct _blueSeg {
+  int x, y1, y2, id;
+} blueSeg;
+
+
+/* **************************************** */
+void ls_from_vector(layerSource* ls, const vector<segment2D>& segments) {
+    ls->segments = segments.empty() ? NULL : &segments[0];
+    ls->nbSegments = segments.size();
+    ls->map = NULL;
+    ls->mapSize = 0;
+    ls->buf.clear();
+}
+
+
+/* Read a whole stream into ls->buf */
+static int ls_read(layerSource* ls, FILE* f, const char* path) {
+    const size_t chunk = 1 << 16;
+    size_t n = 0, r;
+    do {
+        ls->buf.resize(n + chunk);
+        r = fread(&ls->buf[n], sizeof(segment2D), chunk, f);
+        n += r;
+    } while (r == chunk);
+    ls->buf.resize(n);
+    if (ferror(f)) {
+        perror(path);
+        return -1;
+    }
+    ls->segments = n ? &ls->buf[0] : NULL;
+    ls->nbSegments = n;
+    return 0;
+}
+
+
+/* **************************************** */
+int ls_open(layerSource* ls, const char* path) {
+    ls->segments = NULL;
+    ls->nbSegments = 0;
+    ls->map = NULL;
+    ls->mapSize = 0;
+    ls->buf.clear();
+
+    if (strcmp(path, "-") == 0) {
+        return ls_read(ls, stdin, "stdin");
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        FILE* f = fdopen(fd, "rb");
+        if (f == NULL) {
+            perror(path);
+            close(fd);
+            return -1;
+        }
+        int r = ls_read(ls, f, path);
+        fclose(f);
+        return r;
+    }
+    if (st.st_size % sizeof(segment2D) != 0) {
+        fprintf(stderr, "%s: not a file of segments\n", path);
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(path);
+        return -1;
+    }
+    ls->map = map;
+    ls->mapSize = st.st_size;
+    ls->segments = (const segment2D*)map;
+    ls->nbSegments = st.st_size / sizeof(segment2D);
+    return 0;
+}
+
+
+/* **************************************** */
+void ls_close(layerSource* ls) {
+    if (ls->map != NULL) {
+        munmap(ls->map, ls->mapSize);
+    }
+    ls->map = NULL;
+    ls->mapSize = 0;
+    ls->buf.clear();
+    ls->segments = NULL;
+    ls->nbSegments = 0;
+}
+
+
+/* **************************************** */
+int ls_save(const vector<segment2D>& segments, const char* path) {
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    if (!segments.empty()
+        && fwrite(&segments[0], sizeof(segment2D), segments.size(), f) != segments.size()) {
+        perror(path);
+        fclose(f);
+        return -1;
+    }
+    if (fclose(f) != 0) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+
+/* The horizontals of A and the verticals of B, with the orders the sweep needs */
+typedef struct _joinInput {
+  vector<redSeg> hs;
+  vector<int> byStart; /* indices of hs by x1 */
+  vector<int> byEnd; /* indices of hs by x2 */
+  vector<blueSeg> vs; /* by x, then id */
+} joinInput;
+
+
+/* Sweep the verticals vs[first, last) against the horizontals, appending the pairs to out */
+static void rb_sweep(const joinInput* in, size_t first, size_t last, vector<joinPair>* out) {
+    if (first >= last) return;
+    const vector<redSeg>& hs = in->hs;
+    const vector<int>& byStart = in->byStart;
+    const vector<int>& byEnd = in->byEnd;
+    size_t nh = hs.size();
+
+    //the horizontals that span the first vertical, and the first start and end past them
+    int x0 = in->vs[first].x;
+    set<pair<int, int> > active;
+    for (size_t j = 0; j < nh; j++) {
+        if (hs[j].x1 <= x0 && x0 <= hs[j].x2) {
+            active.insert(make_pair(hs[j].y, hs[j].id));
+        }
+    }
+    size_t si = upper_bound(byStart.begin(), byStart.end(), x0,
+                            [&](int x, int j) { return x < hs[j].x1; }) - byStart.begin();
+    size_t ei = lower_bound(byEnd.begin(), byEnd.end(), x0,
+                            [&](int j, int x) { return hs[j].x2 < x; }) - byEnd.begin();
+
+    for (size_t i = first; i < last; i++) {
+        const blueSeg& v = in->vs[i];
+        //starts before ends, so that a horizontal ending at x still crosses
+        for (; si < nh && hs[byStart[si]].x1 <= v.x; si++) {
+            const redSeg& h = hs[byStart[si]];
+            active.insert(make_pair(h.y, h.id));
+        }
+        for (; ei < nh && hs[byEnd[ei]].x2 < v.x; ei++) {
+            const redSeg& h = hs[byEnd[ei]];
+            active.erase(make_pair(h.y, h.id));
+        }
+        set<pair<int, int> >::const_iterator it = active.lower_bound(make_pair(v.y1, -1));
+        for (; it != active.end() && it->first <= v.y2; ++it) {
+            joinPair p = {it->second, v.id};
+            out->push_back(p);
+        }
+    }
+}
+
+
+/* **************************************** */
+size_t rb_join(const layerSource* a, const layerSource* b, int nbThreads,
+               vector<joinPair>* out) {
+    joinInput in;
+    for (size_t i = 0; i < a->nbSegments; i++) {
+        const segment2D& s = a->segments[i];
+        if (s.start.x == s.end.x) continue;
+        redSeg h = {s.start.y, min(s.start.x, s.end.x), max(s.start.x, s.end.x), (int)i};
+        in.hs.push_back(h);
+    }
+    for (size_t i = 0; i < b->nbSegments; i++) {
+        const segment2D& s = b->segments[i];
+        if (s.start.x != s.end.x) continue;
+        blueSeg v = {s.start.x, min(s.start.y, s.end.y), max(s.start.y, s.end.y), (int)i};
+        in.vs.push_back(v);
+    }
+    in.byStart.resize(in.hs.size());
+    for (size_t j = 0; j < in.hs.size(); j++) in.byStart[j] = j;
+    in.byEnd = in.byStart;
+    const vector<redSeg>& hs = in.hs;
+    sort(in.byStart.begin(), in.byStart.end(), [&](int i, int j) { return hs[i].x1 < hs[j].x1; });
+    sort(in.byEnd.begin(), in.byEnd.end(), [&](int i, int j) { return hs[i].x2 < hs[j].x2; });
+    //the ids are already in order, and a stable sort keeps it
+    stable_sort(in.vs.begin(), in.vs.end(), [](const blueSeg& u, const blueSeg& v) { return u.x < v.x; });
+
+    out->clear();
+    size_t nv = in.vs.size();
+    if (nbThreads <= 1 || nv < (size_t)nbThreads) {
+        rb_sweep(&in, 0, nv, out);
+        return out->size();
+    }
+
+    vector<vector<joinPair> > slabs(nbThreads);
+    vector<thread> threads;
+    for (int t = 0; t < nbThreads; t++) {
+        size_t first = nv * t / nbThreads, last = nv * (t + 1) / nbThreads;
+        threads.push_back(thread(rb_sweep, &in, first, last, &slabs[t]));
+    }
+    size_t total = 0;
+    for (int t = 0; t < nbThreads; t++) {
+        threads[t].join();
+        total += slabs[t].size();
+    }
+    out->reserve(total);
+    for (int t = 0; t < nbThreads; t++) {
+        out->insert(out->end(), slabs[t].begin(), slabs[t].end());
+        vector<joinPair>().swap(slabs[t]);
+    }
+    return out->size();
+}
@@ -0,0 +1,68 @@
+#ifndef __join_h
+#define __join_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include "geom.h"
+
+
+/* Red-blue join: the intersections between the horizontal segments of
+   a layer A and the vertical segments of a layer B, reported as pairs
+   of ids, without ever looking at A-A or B-B pairs. The verticals of A
+   and the horizontals of B are ignored.
+
+   A layer is a file of segment2D records and nothing else, the id of a
+   segment being its position in the file. A regular file is mapped
+   with mmap; anything else (a pipe, "-" for stdin) is read as a stream
+   into memory, since the join needs each layer sorted.
+
+   The sweep goes over the verticals of B by x; before the vertical at
+   x, the horizontals of A with x1 <= x are added to the active set and
+   those with x2 < x removed, so that a segment that ends on the other
+   counts. The active set is kept by (y, id) so that the pairs of a
+   vertical come out in order of y.
+
+   With t threads the verticals are cut into t slabs of as many
+   verticals each. A slab starts from the horizontals of A that span
+   the x of its first vertical, found by one scan of A, and sweeps its
+   verticals like the serial join; the pairs come out in the same order
+   as serially once the slabs are put back in order.
+ */
+
+typedef struct _layerSource {
+  const segment2D* segments;
+  size_t nbSegments;
+  void* map; /* the mapping, or NULL if the layer was read into buf */
+  size_t mapSize;
+  std::vector<segment2D> buf;
+} layerSource;
+
+
+typedef struct _joinPair {
+  int a; /* id of the horizontal in layer A */
+  int b; /* id of the vertical in layer B */
+} joinPair;
+
+
+/* opens the layer in path: mapped if it is a regular file, read in
+   full otherwise ("-" is stdin). Returns 0 on success, -1 on failure */
+int ls_open(layerSource* ls, const char* path);
+
+/* a layer over segments, which must outlive it */
+void ls_from_vector(layerSource* ls, const std::vector<segment2D>& segments);
+
+void ls_close(layerSource* ls);
+
+/* writes segments to path as a layer. Returns 0 on success, -1 on failure */
+int ls_save(const std::vector<segment2D>& segments, const char* path);
+
+
+/* replaces out with the intersections of the horizontals of a and the
+   verticals of b, by x of the vertical, then id of the vertical, then
+   y. nbThreads > 1 sweeps slabs in parallel. Returns the number of pairs */
+size_t rb_join(const layerSource* a, const layerSource* b, int nbThreads,
+               std::vector<joinPair>* out);
+
+#endif
@@ -0,0 +1,366 @@
+#include "liveindex.h"
+#include "ostree.h"
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+
+using namespace std;
+
+
+/* A rebuild running in its own thread, over a copy of the segments
+   taken when it started; only that thread writes base and status
+   until done is set */
+typedef struct _lxRebuild {
+  vector<segment2D> segments;
+  vector<char> alive;
+  bool windowCounter;
+  segIndex base;
+  int status; /* of si_build */
+  atomic<int> done;
+  thread worker;
+} lxRebuild;
+
+
+/* Builds in base the static index over the segments with alive[id] != 0.
+   Returns 0 on success, -1 on failure */
+static int lx_build_base(segIndex* base, const vector<segment2D>& segments,
+                         const vector<char>& alive, bool windowCounter) {
+    vector<event> events;
+    create_events(segments, &alive, &events);
+    sort(events.begin(), events.end(), event_before);
+    return si_build(base, events, segments, &alive, windowCounter);
+}
+
+/* Rebuilds the static index over the live segments. Returns 0 on
+   success, -1 on failure, and then keeps the old one */
+static int lx_rebuild(liveIndex* lx) {
+    segIndex base;
+    if (lx_build_base(&base, lx->segments, lx->alive, lx->windowCounter) != 0) {
+        return -1;
+    }
+    si_close(&lx->base);
+    lx->base = base;
+    lx->inBase = lx->alive;
+    lx->added.clear();
+    lx->removed.clear();
+    lx->nbRebuilds++;
+    return 0;
+}
+
+
+/* **************************************** */
+int lx_init(liveIndex* lx, segIndex* base, bool windowCounter) {
+    lx->base = *base;
+    lx->rebuild = NULL;
+    memset(base, 0, sizeof(segIndex));
+
+    //Recover the segments from the start and vertical events
+    lx->segments.clear();
+    lx->alive.clear();
+    for (size_t i = 0; i < lx->base.nbEvents; i++) {
+        const event& e = lx->base.events[i];
+        if (e.eventType == 'E') continue;
+        //a segment has at least one event, so its id is below nbEvents
+        if (e.segmentId < 0 || (size_t)e.segmentId >= lx->base.nbEvents) {
+            fprintf(stderr, "corrupt index: event of segment %d\n", e.segmentId);
+            si_close(&lx->base);
+            return -1;
+        }
+        if (e.segmentId >= (int)lx->segments.size()) {
+            lx->segments.resize(e.segmentId + 1);
+            lx->alive.resize(e.segmentId + 1, 0);
+        }
+        lx->segments[e.segmentId] = normalize_segment(e.segment);
+        lx->alive[e.segmentId] = 1;
+    }
+    lx->inBase = lx->alive;
+    lx->nbAlive = count(lx->alive.begin(), lx->alive.end(), 1);
+    lx->added.clear();
+    lx->removed.clear();
+    lx->nbRebuilds = 0;
+    lx->windowCounter = windowCounter;
+    if (windowCounter && lx->base.wc.nbNodes == 0) {
+        fprintf(stderr, "the index has no window counter, building one\n");
+        if (lx_rebuild(lx) != 0) {
+            si_close(&lx->base);
+            return -1;
+        }
+        lx->nbRebuilds = 0;
+    }
+    return 0;
+}
+
+
+/* **************************************** */
+int lx_init_segments(liveIndex* lx, const vector<segment2D>& segments, bool windowCounter) {
+    vector<event> events;
+    segIndex base;
+
+    create_events(segments, NULL, &events);
+    sort(events.begin(), events.end(), event_before);
+    if (si_build(&base, events, segments, NULL, windowCounter) != 0) {
+        return -1;
+    }
+    return lx_init(lx, &base, windowCounter);
+}
+
+
+/* **************************************** */
+void lx_close(liveIndex* lx) {
+    lx_finish_rebuild(lx, true);
+    si_close(&lx->base);
+}
+
+
+/* **************************************** */
+int lx_insert(liveIndex* lx, segment2D s) {
+    int id = (int)lx->segments.size();
+    lx->segments.push_back(normalize_segment(s));
+    lx->alive.push_back(1);
+    lx->inBase.push_back(0);
+    lx->added.push_back(id);
+    lx->nbAlive++;
+    return id;
+}
+
+
+/* **************************************** */
+int lx_delete(liveIndex* lx, int id) {
+    if (id < 0 || id >= (int)lx->segments.size() || !lx->alive[id]) {
+        return -1;
+    }
+    lx->alive[id] = 0;
+    lx->nbAlive--;
+    if (lx->inBase[id]) {
+        lx->removed.push_back(id);
+    } else {
+        //an insertion since the last rebuild just goes away
+        vector<int>::iterator it = find(lx->added.begin(), lx->added.end(), id);
+        assert(it != lx->added.end());
+        *it = lx->added.back();
+        lx->added.pop_back();
+    }
+    return 0;
+}
+
+
+/* **************************************** */
+int lx_maybe_rebuild(liveIndex* lx) {
+    size_t delta = lx->added.size() + lx->removed.size();
+    size_t limit = max((size_t)LX_MIN_DELTA, (size_t)sqrt((double)lx->nbAlive));
+    if (delta <= limit) {
+        return 0;
+    }
+    //on failure keep answering from the side lists
+    return lx_rebuild(lx) == 0 ? 1 : 0;
+}
+
+
+/* Builds the static index of r; runs in r's thread */
+static void lx_rebuild_run(lxRebuild* r) {
+    r->status = lx_build_base(&r->base, r->segments, r->alive, r->windowCounter);
+    r->done.store(1, memory_order_release);
+}
+
+
+/* **************************************** */
+int lx_start_rebuild(liveIndex* lx) {
+    size_t delta = lx->added.size() + lx->removed.size();
+    size_t limit = max((size_t)LX_MIN_DELTA, (size_t)sqrt((double)lx->nbAlive));
+    if (lx->rebuild != NULL || delta <= limit) {
+        return 0;
+    }
+
+    //the copies are O(n) and cheap next to the O(n log n) build
+    lxRebuild* r = new lxRebuild;
+    r->segments = lx->segments;
+    r->alive = lx->alive;
+    r->windowCounter = lx->windowCounter;
+    r->status = -1;
+    r->done.store(0);
+    r->worker = thread(lx_rebuild_run, r);
+    lx->rebuild = r;
+    return 1;
+}
+
+
+/* **************************************** */
+int lx_finish_rebuild(liveIndex* lx, bool wait) {
+    lxRebuild* r = lx->rebuild;
+    if (r == NULL || (!wait && !r->done.load(memory_order_acquire))) {
+        return 0;
+    }
+    r->worker.join();
+    lx->rebuild = NULL;
+    if (r->status != 0) {
+        delete r;
+        return 0;
+    }
+
+    //The new base holds the segments alive when the rebuild started;
+    //the side lists become what changed since then
+    si_close(&lx->base);
+    lx->base = r->base;
+    lx->inBase.swap(r->alive);
+    lx->inBase.resize(lx->segments.size(), 0);
+    lx->added.clear();
+    lx->removed.clear();
+    for (size_t id = 0; id < lx->segments.size(); id++) {
+        if (lx->alive[id] && !lx->inBase[id]) lx->added.push_back((int)id);
+        if (!lx->alive[id] && lx->inBase[id]) lx->removed.push_back((int)id);
+    }
+    lx->nbRebuilds++;
+    delete r;
+    return 1;
+}
+
+
+/* **************************************** */
+size_t lx_report(const liveIndex* lx, int x, int y1, int y2, vector<int>* out) {
+    if (y1 > y2) swap(y1, y2);
+    size_t first = out->size();
+
+    si_report(&lx->base, x, y1, y2, out);
+    if (!lx->removed.empty()) {
+        //drop the deleted ones
+        size_t j = first;
+        for (size_t i = first; i < out->size(); i++) {
+            int id = (*out)[i];
+            if (id >= 0 && id < (int)lx->alive.size() && lx->alive[id]) (*out)[j++] = id;
+        }
+        out->resize(j);
+    }
+    for (size_t i = 0; i < lx->added.size(); i++) {
+        int id = lx->added[i];
+        if (crosses_vertical(lx->segments[id], x, y1, y2)) {
+            out->push_back(id);
+        }
+    }
+    return out->size() - first;
+}
+
+
+/* **************************************** */
+size_t lx_count(const liveIndex* lx, int x, int y1, int y2) {
+    if (y1 > y2) swap(y1, y2);
+
+    size_t k = si_count(&lx->base, x, y1, y2);
+    for (size_t i = 0; i < lx->removed.size(); i++) {
+        if (crosses_vertical(lx->segments[lx->removed[i]], x, y1, y2)) k--;
+    }
+    for (size_t i = 0; i < lx->added.size(); i++) {
+        int id = lx->added[i];
+        if (crosses_vertical(lx->segments[id], x, y1, y2)) k++;
+    }
+    return k;
+}
+
+
+/* Intersections inside the window of the horizontals hs with the
+   verticals vs. The two lists can each hold up to sqrt(n) segments, so
+   rather than check every pair this sweeps them over x with the heights
+   of the horizontals in an order-statistic tree:
+   O((|hs| + |vs|) log n) */
+static int64_t crossingsInWindow(const liveIndex* lx, const vector<int>& hs, const vector<int>& vs,
+                                 int x1, int x2, int y1, int y2) {
+    if (hs.empty() || vs.empty()) return 0;
+
+    //the segments clipped to the window, as sweep events
+    vector<event> events;
+    event e;
+    memset(&e, 0, sizeof(e));
+    for (size_t i = 0; i < hs.size(); i++) {
+        const segment2D& h = lx->segments[hs[i]];
+        int lo = max(h.start.x, x1), hi = min(h.end.x, x2);
+        if (h.start.y < y1 || h.start.y > y2 || lo > hi) continue;
+        e.segment = h;
+        e.eventType = 'S';
+        e.eventXCoord = lo;
+        events.push_back(e);
+        e.eventType = 'E';
+        e.eventXCoord = hi;
+        events.push_back(e);
+    }
+    for (size_t j = 0; j < vs.size(); j++) {
+        const segment2D& v = lx->segments[vs[j]];
+        int lo = max(v.start.y, y1), hi = min(v.end.y, y2);
+        if (v.start.x < x1 || v.start.x > x2 || lo > hi) continue;
+        e.segment = v;
+        e.segment.start.y = lo;
+        e.segment.end.y = hi;
+        e.eventType = 'V';
+        e.eventXCoord = v.start.x;
+        events.push_back(e);
+    }
+    sort(events.begin(), events.end(), event_before);
+
+    osTree<int> active;
+    int64_t k = 0;
+    for (size_t i = 0; i < events.size(); i++) {
+        const event& ev = events[i];
+        if (ev.eventType == 'S') {
+            os_insert(&active, ev.segment.start.y);
+        } else if (ev.eventType == 'E') {
+            os_erase(&active, ev.segment.start.y);
+        } else {
+            k += os_count(&active, ev.segment.start.y, ev.segment.end.y);
+        }
+    }
+    return k;
+}
+
+/* Intersections inside the window of s with all the segments of base,
+   including the deleted ones */
+static int64_t baseCrossingsInWindow(const liveIndex* lx, const segment2D& s,
+                                     int x1, int x2, int y1, int y2) {
+    if (is_horizontal(s)) {
+        int y = s.start.y;
+        int lo = max(s.start.x, x1), hi = min(s.end.x, x2);
+        if (y < y1 || y > y2 || lo > hi) return 0;
+        return wc_stab(&lx->base.wc, hi, y) - wc_stab(&lx->base.wc, lo - 1, y);
+    }
+    int x = s.start.x;
+    int lo = max(s.start.y, y1), hi = min(s.end.y, y2);
+    if (x < x1 || x > x2 || lo > hi) return 0;
+    return si_count(&lx->base, x, lo, hi);
+}
+
+
+/* **************************************** */
+size_t lx_count_window(const liveIndex* lx, int x1, int x2, int y1, int y2) {
+    if (x1 > x2) swap(x1, x2);
+    if (y1 > y2) swap(y1, y2);
+
+    //Split the side lists into horizontals and verticals
+    vector<int> removedH, removedV, addedH, addedV;
+    for (size_t i = 0; i < lx->removed.size(); i++) {
+        int id = lx->removed[i];
+        (is_horizontal(lx->segments[id]) ? removedH : removedV).push_back(id);
+    }
+    for (size_t i = 0; i < lx->added.size(); i++) {
+        int id = lx->added[i];
+        (is_horizontal(lx->segments[id]) ? addedH : addedV).push_back(id);
+    }
+
+    //Everything in base, less what the deleted segments took part in,
+    //plus what the inserted ones cross among the live segments
+    int64_t k = wc_count(&lx->base.wc, x1, x2, y1, y2);
+    for (size_t i = 0; i < lx->removed.size(); i++) {
+        k -= baseCrossingsInWindow(lx, lx->segments[lx->removed[i]], x1, x2, y1, y2);
+    }
+    k += crossingsInWindow(lx, removedH, removedV, x1, x2, y1, y2);
+    for (size_t i = 0; i < addedH.size(); i++) {
+        k += baseCrossingsInWindow(lx, lx->segments[addedH[i]], x1, x2, y1, y2);
+    }
+    for (size_t i = 0; i < addedV.size(); i++) {
+        k += baseCrossingsInWindow(lx, lx->segments[addedV[i]], x1, x2, y1, y2);
+    }
+    k -= crossingsInWindow(lx, addedH, removedV, x1, x2, y1, y2);
+    k -= crossingsInWindow(lx, removedH, addedV, x1, x2, y1, y2);
+    k += crossingsInWindow(lx, addedH, addedV, x1, x2, y1, y2);
+    return (size_t)k;
+}
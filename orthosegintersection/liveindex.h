@@ -0,0 +1,98 @@
+#ifndef __liveindex_h
+#define __liveindex_h
+
+#include <vector>
+#include "geom.h"
+#include "segindex.h"
+
+
+/* A segIndex that also takes insertions and deletions.
+
+   The static index is left untouched; the segments inserted since it
+   was built and the indexed segments deleted since then are kept on
+   the side and merged into every answer. Once the side lists grow past
+   max(LX_MIN_DELTA, sqrt(n)) the static index is rebuilt over the live
+   segments, which keeps both the per-query cost of the side lists and
+   the amortized cost of the rebuilds sublinear.
+
+   The rebuild is either done in place (lx_maybe_rebuild) or, for a
+   server that must keep answering meanwhile, in a thread of its own
+   over a copy of the live segments (lx_start_rebuild), and swapped in
+   with the side lists recomputed against it once it is done
+   (lx_finish_rebuild), as the concurrent index does.
+
+   Segment ids are positions in segments and are never reused.
+ */
+
+#define LX_MIN_DELTA 1024
+
+/* A rebuild running in the background (see liveindex.cpp) */
+struct _lxRebuild;
+
+typedef struct _liveIndex {
+  segIndex base; /* static index over the segments live at the last rebuild */
+  std::vector<segment2D> segments; /* every segment ever inserted, by id */
+  std::vector<char> alive; /* 0 once deleted */
+  std::vector<char> inBase; /* 1 if indexed by base */
+  std::vector<int> added; /* live ids inserted since the last rebuild */
+  std::vector<int> removed; /* ids of base deleted since the last rebuild */
+  size_t nbAlive;
+  size_t nbRebuilds;
+  bool windowCounter; /* the static index carries a window counter, for lx_count_window */
+  struct _lxRebuild* rebuild; /* the background rebuild in progress, or NULL */
+} liveIndex;
+
+
+/* takes over base, which was built or loaded from an index over all
+   the segments it holds. If windowCounter is true and base has no
+   window counter, the static index is rebuilt with one. Returns 0 on
+   success, -1 on failure */
+int lx_init(liveIndex* lx, segIndex* base, bool windowCounter = false);
+
+/* builds the index over segments, with a window counter if
+   windowCounter is true. Returns 0 on success, -1 on failure */
+int lx_init_segments(liveIndex* lx, const std::vector<segment2D>& segments,
+                     bool windowCounter = false);
+
+/* waits for a background rebuild and releases the static index */
+void lx_close(liveIndex* lx);
+
+
+/* adds s and returns its id */
+int lx_insert(liveIndex* lx, segment2D s);
+
+/* deletes segment id. Returns 0 on success, -1 if there is no such live segment */
+int lx_delete(liveIndex* lx, int id);
+
+/* rebuilds the static index if the side lists have grown too long;
+   returns 1 if it did */
+int lx_maybe_rebuild(liveIndex* lx);
+
+/* starts rebuilding the static index in a background thread if the
+   side lists have grown too long and no rebuild is running; returns 1
+   if it started one */
+int lx_start_rebuild(liveIndex* lx);
+
+/* swaps in the index of the background rebuild if it is done, or once
+   it is if wait is true, and recomputes the side lists against it.
+   Returns 1 if it swapped one in, 0 if there is none yet or the
+   rebuild failed */
+int lx_finish_rebuild(liveIndex* lx, bool wait);
+
+
+/* appends to out the ids of the live horizontal segments that
+   intersect the vertical segment x=x, y1<=y<=y2; returns how many */
+size_t lx_report(const liveIndex* lx, int x, int y1, int y2, std::vector<int>* out);
+
+/* returns the number of live horizontal segments that intersect the
+   vertical segment x=x, y1<=y<=y2 */
+size_t lx_count(const liveIndex* lx, int x, int y1, int y2);
+
+/* returns the number of intersections between live segments that lie
+   in the window [x1,x2] x [y1,y2], from the window counter of the
+   static index (lx->windowCounter must be true) corrected for the
+   side lists: O(log^2 n) per segment in the side lists, and a sweep
+   over them for their own intersections */
+size_t lx_count_window(const liveIndex* lx, int x1, int x2, int y1, int y2);
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef __ostree_h
+#define __ostree_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+
+/* An ordered multiset of keys that also knows how many keys lie in a
+   range, for the active structures that count the horizontals crossed
+   by a vertical: a multiset has to walk them, which makes a count
+   O(log n + k), while here it is the difference of two ranks, O(log n).
+
+   It is a treap, flat and pointer-free like the window counter: the
+   nodes live in a vector, children are indices (-1 for none) and the
+   nodes of erased keys are reused. Equal keys share a node with a
+   multiplicity, and every node keeps the number of keys below it, so
+   the rank of a key is summed up on the way down to it. Insert, erase
+   and count take O(log n) expected time, a report O(log n + k).
+
+   Key only needs < and ==.
+ */
+
+template <class Key>
+struct osNode {
+  Key key;
+  uint32_t prio; /* heap order: a parent has a higher priority than its children */
+  int count; /* copies of key */
+  int size; /* keys in the subtree, copies included */
+  int left, right;
+};
+
+template <class Key>
+struct osTree {
+  std::vector<osNode<Key> > nodes;
+  std::vector<int> freeNodes;
+  int root = -1;
+  uint32_t seed = 2463534242u;
+};
+
+
+template <class Key>
+inline int os_size(const osTree<Key>* t, int n) { return n < 0 ? 0 : t->nodes[n].size; }
+
+template <class Key>
+inline void os_update(osTree<Key>* t, int n) {
+    osNode<Key>& node = t->nodes[n];
+    node.size = node.count + os_size(t, node.left) + os_size(t, node.right);
+}
+
+
+/* empties t */
+template <class Key>
+void os_clear(osTree<Key>* t) {
+    t->nodes.clear();
+    t->freeNodes.clear();
+    t->root = -1;
+}
+
+/* number of keys in t */
+template <class Key>
+size_t os_size(const osTree<Key>* t) { return os_size(t, t->root); }
+
+
+/* A node holding one copy of key */
+template <class Key>
+int os_new_node(osTree<Key>* t, const Key& key) {
+    //xorshift32
+    t->seed ^= t->seed << 13;
+    t->seed ^= t->seed >> 17;
+    t->seed ^= t->seed << 5;
+    osNode<Key> node = {key, t->seed, 1, 1, -1, -1};
+    if (!t->freeNodes.empty()) {
+        int n = t->freeNodes.back();
+        t->freeNodes.pop_back();
+        t->nodes[n] = node;
+        return n;
+    }
+    t->nodes.push_back(node);
+    return (int)t->nodes.size() - 1;
+}
+
+/* Adds one copy of key below n; returns the new root of the subtree */
+template <class Key>
+int os_insert_at(osTree<Key>* t, int n, const Key& key) {
+    if (n < 0) return os_new_node(t, key);
+    if (key == t->nodes[n].key) {
+        t->nodes[n].count++;
+        t->nodes[n].size++;
+        return n;
+    }
+    if (key < t->nodes[n].key) {
+        int c = os_insert_at(t, t->nodes[n].left, key);
+        t->nodes[n].left = c;
+        if (t->nodes[c].prio > t->nodes[n].prio) {
+            //rotate right
+            t->nodes[n].left = t->nodes[c].right;
+            t->nodes[c].right = n;
+            os_update(t, n);
+            n = c;
+        }
+    } else {
+        int c = os_insert_at(t, t->nodes[n].right, key);
+        t->nodes[n].right = c;
+        if (t->nodes[c].prio > t->nodes[n].prio) {
+            //rotate left
+            t->nodes[n].right = t->nodes[c].left;
+            t->nodes[c].left = n;
+            os_update(t, n);
+            n = c;
+        }
+    }
+    os_update(t, n);
+    return n;
+}
+
+/* The subtrees a and b, all of whose keys are smaller than those of b, as one */
+template <class Key>
+int os_merge(osTree<Key>* t, int a, int b) {
+    if (a < 0) return b;
+    if (b < 0) return a;
+    if (t->nodes[a].prio > t->nodes[b].prio) {
+        int c = os_merge(t, t->nodes[a].right, b);
+        t->nodes[a].right = c;
+        os_update(t, a);
+        return a;
+    }
+    int c = os_merge(t, a, t->nodes[b].left);
+    t->nodes[b].left = c;
+    os_update(t, b);
+    return b;
+}
+
+/* Removes one copy of key below n, which must hold it; returns the new
+   root of the subtree */
+template <class Key>
+int os_erase_at(osTree<Key>* t, int n, const Key& key) {
+    osNode<Key>& node = t->nodes[n];
+    if (key == node.key) {
+        if (node.count > 1) {
+            node.count--;
+            node.size--;
+            return n;
+        }
+        t->freeNodes.push_back(n);
+        return os_merge(t, node.left, node.right);
+    }
+    if (key < node.key) {
+        node.left = os_erase_at(t, node.left, key);
+    } else {
+        node.right = os_erase_at(t, node.right, key);
+    }
+    node.size--;
+    return n;
+}
+
+
+/* adds one copy of key */
+template <class Key>
+void os_insert(osTree<Key>* t, const Key& key) { t->root = os_insert_at(t, t->root, key); }
+
+/* returns the number of copies of key in t */
+template <class Key>
+int os_find(const osTree<Key>* t, const Key& key) {
+    for (int n = t->root; n >= 0; ) {
+        const osNode<Key>& node = t->nodes[n];
+        if (key == node.key) return node.count;
+        n = key < node.key ? node.left : node.right;
+    }
+    return 0;
+}
+
+/* removes one copy of key. Returns 0 on success, -1 if key is not in t */
+template <class Key>
+int os_erase(osTree<Key>* t, const Key& key) {
+    if (os_find(t, key) == 0) return -1;
+    t->root = os_erase_at(t, t->root, key);
+    return 0;
+}
+
+
+/* returns the number of keys < key, or <= key if inclusive */
+template <class Key>
+size_t os_rank(const osTree<Key>* t, const Key& key, bool inclusive) {
+    size_t r = 0;
+    for (int n = t->root; n >= 0; ) {
+        const osNode<Key>& node = t->nodes[n];
+        if (key < node.key || (!inclusive && key == node.key)) {
+            n = node.left;
+        } else {
+            r += os_size(t, node.left) + node.count;
+            n = node.right;
+        }
+    }
+    return r;
+}
+
+/* returns the number of keys with lo <= key <= hi */
+template <class Key>
+size_t os_count(const osTree<Key>* t, const Key& lo, const Key& hi) {
+    if (hi < lo) return 0;
+    return os_rank(t, hi, true) - os_rank(t, lo, false);
+}
+
+
+/* calls f(key) for every copy of the keys in [lo, hi] below n, in order */
+template <class Key, class F>
+void os_report_at(const osTree<Key>* t, int n, const Key& lo, const Key& hi, F& f) {
+    while (n >= 0) {
+        const osNode<Key>& node = t->nodes[n];
+        if (node.key < lo) {
+            n = node.right;
+        } else if (hi < node.key) {
+            n = node.left;
+        } else {
+            os_report_at(t, node.left, lo, hi, f);
+            for (int c = 0; c < node.count; c++) f(node.key);
+            n = node.right;
+        }
+    }
+}
+
+/* calls f(key) for every key with lo <= key <= hi, in order */
+template <class Key, class F>
+void os_report(const osTree<Key>* t, const Key& lo, const Key& hi, F f) {
+    os_report_at(t, t->root, lo, hi, f);
+}
+
+#endif
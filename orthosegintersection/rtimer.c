@@ -38,6 +38,12 @@
 #include <string.h>
 #include <strings.h>
 #include <assert.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
 
 #include "rtimer.h"
 
@@ -101,3 +107,206 @@ rt_sprint_total(char *buf, Rtimer rt) {
   }
   return buf;
 }
+
+
+
+/* ************************************************************ */
+/* hardware performance counters */
+
+#ifdef __linux__
+/* opens one counter, as the leader of a new group if group is -1 */
+static int
+rp_open(__u32 type, __u64 config, int group) {
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  /* user space only: this is what paranoid level 2 still allows */
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP
+    | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+
+
+void
+rp_group_open(RperfGroup* g) {
+  int i;
+#ifdef __linux__
+  static const __u32 type[RP_NB_COUNTERS] = {
+    PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+    PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE
+  };
+  static const __u64 config[RP_NB_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_L1D
+    | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+    | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+  };
+#endif
+
+  assert(g);
+  g->leader = -1;
+  g->nb = 0;
+  for(i = 0; i < RP_NB_COUNTERS; i++) {
+    g->fd[i] = -1;
+    g->slot[i] = -1;
+  }
+#ifdef __linux__
+  /* the first counter that opens leads the group; a group read
+     returns the values in the order the counters joined it */
+  for(i = 0; i < RP_NB_COUNTERS; i++) {
+    g->fd[i] = rp_open(type[i], config[i], g->leader);
+    if(g->fd[i] < 0) {
+      g->fd[i] = -1;
+      continue;
+    }
+    if(g->leader < 0) {
+      g->leader = g->fd[i];
+    }
+    g->slot[i] = g->nb++;
+  }
+#endif
+}
+
+
+void
+rp_group_close(RperfGroup* g) {
+  int i;
+
+  assert(g);
+  /* the members first, then the leader */
+  for(i = RP_NB_COUNTERS - 1; i >= 0; i--) {
+    if(g->fd[i] >= 0) {
+      close(g->fd[i]);
+    }
+    g->fd[i] = -1;
+    g->slot[i] = -1;
+  }
+  g->leader = -1;
+  g->nb = 0;
+}
+
+
+/* reads all the counters of the group at once, with the time the
+   group was enabled and the time it was actually on the PMU. Returns
+   0 on success, -1 on failure */
+static int
+rp_group_read(const RperfGroup* g, long long v[RP_NB_COUNTERS],
+	      long long* enabled, long long* running) {
+  unsigned long long buf[3 + RP_NB_COUNTERS];
+  ssize_t size = (ssize_t)((3 + g->nb) * sizeof(buf[0]));
+  int i;
+
+  if(g->leader < 0 || read(g->leader, buf, size) != size
+     || buf[0] != (unsigned long long)g->nb) {
+    return -1;
+  }
+  *enabled = (long long)buf[1];
+  *running = (long long)buf[2];
+  for(i = 0; i < RP_NB_COUNTERS; i++) {
+    v[i] = g->slot[i] < 0 ? 0 : (long long)buf[3 + g->slot[i]];
+  }
+  return 0;
+}
+
+
+void
+rp_init(Rperf* rp, RperfGroup* g) {
+  int i;
+
+  assert(rp && g);
+  rp->group = g;
+  rp->enabled = (g->leader >= 0);
+  for(i = 0; i < RP_NB_COUNTERS; i++) {
+    rp->c1[i] = 0;
+    rp->total[i] = 0;
+  }
+  rp->enabled1 = rp->running1 = 0;
+  rp->timeEnabled = rp->timeRunning = 0;
+}
+
+
+void
+rp_start(Rperf* rp) {
+  if(!rp->enabled) return;
+  if(rp_group_read(rp->group, rp->c1, &rp->enabled1, &rp->running1) != 0) {
+    rp->enabled = 0;
+  }
+}
+
+
+void
+rp_stop_and_accumulate(Rperf* rp) {
+  long long c2[RP_NB_COUNTERS], enabled2, running2, enabled, running;
+  int i;
+
+  if(!rp->enabled) return;
+  if(rp_group_read(rp->group, c2, &enabled2, &running2) != 0) {
+    rp->enabled = 0;
+    return;
+  }
+  enabled = enabled2 - rp->enabled1;
+  running = running2 - rp->running1;
+  rp->timeEnabled += enabled;
+  rp->timeRunning += running;
+  /* the group was on the PMU for running out of enabled ns of the
+     phase, all its counters together: scale them up to the whole
+     phase. If it never got on, there is nothing to scale */
+  if(running <= 0) return;
+  for(i = 0; i < RP_NB_COUNTERS; i++) {
+    rp->total[i] += (double)(c2[i] - rp->c1[i]) * enabled / running;
+  }
+}
+
+
+/* prints one counter, or n/a if it is not open */
+static char *
+rp_sprint_counter(char *buf, const char *name, Rperf rp, int i) {
+  if(rp.group->slot[i] < 0) {
+    sprintf(buf, "%s n/a", name);
+  } else {
+    sprintf(buf, "%s %.3g", name, (double)rp.total[i]);
+  }
+  return buf;
+}
+
+
+char *
+rp_sprint(char *buf, Rperf rp) {
+  char cyc[64], ins[64], l1d[64], llc[64], br[64], ipc[64], run[64];
+
+  if(!rp.enabled) {
+    sprintf(buf, "[perf n/a]");
+    return buf;
+  }
+  if(rp.group->slot[RP_CYCLES] >= 0 && rp.group->slot[RP_INSTRUCTIONS] >= 0
+     && rp.total[RP_CYCLES] > 0) {
+    sprintf(ipc, "ipc %.2f", rp.total[RP_INSTRUCTIONS] / rp.total[RP_CYCLES]);
+  } else {
+    sprintf(ipc, "ipc n/a");
+  }
+  /* the share of the phase the counts were measured over, if the
+     group had to be multiplexed with other events */
+  if(rp.timeEnabled > 0 && rp.timeRunning < rp.timeEnabled) {
+    sprintf(run, " run %.0f%%", 100.0 * rp.timeRunning / rp.timeEnabled);
+  } else {
+    run[0] = 0;
+  }
+  sprintf(buf, "[%s %s %s %s %s %s%s]",
+	  rp_sprint_counter(cyc, "cyc", rp, RP_CYCLES),
+	  rp_sprint_counter(ins, "ins", rp, RP_INSTRUCTIONS),
+	  ipc,
+	  rp_sprint_counter(l1d, "l1d-miss", rp, RP_L1D_MISSES),
+	  rp_sprint_counter(llc, "llc-miss", rp, RP_LLC_MISSES),
+	  rp_sprint_counter(br, "br-miss", rp, RP_BRANCH_MISSES),
+	  run);
+  return buf;
+}
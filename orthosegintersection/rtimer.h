@@ -40,6 +40,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <time.h>
+
+/* rtimer.c may be compiled as C while the rest is C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 typedef struct {
   struct rusage rut1, rut2; /* used to get user and system time */
@@ -131,4 +137,87 @@ char* rt_sprint_average(char *buf, Rtimer rt, int k);
 /* to be called after rt_stop_and_accumulate to print the total time */
 char* rt_sprint_total(char* buf, Rtimer rt);
 
+
+/* microseconds on a monotonic clock, for latencies and deadlines that
+   must not jump with the wall clock */
+static inline double rt_now_usec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+/* percentile q (0<=q<=1) of the n values in sorted, 0 if n is 0 */
+static inline double rt_percentile(const double* sorted, size_t n, double q) {
+  size_t i;
+  if (n == 0) return 0;
+  i = (size_t)(q * n);
+  return sorted[i < n ? i : n - 1];
+}
+
+
+
+/* Optional hardware performance counters, kept next to an Rtimer to
+   see what a phase does to the caches and the branch predictor, not
+   just how long it takes. On Linux they are read with
+   perf_event_open; anywhere else, or when the kernel does not permit
+   it (see /proc/sys/kernel/perf_event_paranoid), the counters stay
+   closed and print as n/a.
+
+   The counters are opened once, as one group, so that the kernel puts
+   them on the PMU together and they all count over the same time
+   slices; a ratio such as ipc is then taken over the same cycles. The
+   phases share the group: each Rperf reads the group at rp_start and
+   rp_stop_and_accumulate and adds up the differences, scaled by the
+   time the group was enabled over the time it actually ran, in case
+   the kernel had to multiplex it with other events. */
+#define RP_CYCLES 0
+#define RP_INSTRUCTIONS 1
+#define RP_L1D_MISSES 2
+#define RP_LLC_MISSES 3
+#define RP_BRANCH_MISSES 4
+#define RP_NB_COUNTERS 5
+
+typedef struct {
+  int leader; /* fd of the group leader, -1 if no counter could be opened */
+  int fd[RP_NB_COUNTERS]; /* -1 if the counter could not be opened */
+  int slot[RP_NB_COUNTERS]; /* position in a group read, -1 if not open */
+  int nb; /* counters in the group */
+} RperfGroup;
+
+typedef struct {
+  RperfGroup* group;
+  int enabled; /* 1 if the group is open */
+  long long c1[RP_NB_COUNTERS]; /* counter values at rp_start */
+  long long enabled1, running1; /* group times at rp_start, in ns */
+  double total[RP_NB_COUNTERS]; /* scaled, accumulated over start/stop pairs */
+  long long timeEnabled, timeRunning; /* accumulated over start/stop pairs */
+} Rperf;
+
+
+/* opens the counters for the calling thread as one group; never
+   fails, a counter that is not permitted is just left out */
+void rp_group_open(RperfGroup* g);
+
+/* closes all open counters */
+void rp_group_close(RperfGroup* g);
+
+/* zeroes rp, which counts with the counters of g */
+void rp_init(Rperf* rp, RperfGroup* g);
+
+/* records the current counter values */
+void rp_start(Rperf* rp);
+
+/* adds the counts since the last rp_start to the totals */
+void rp_stop_and_accumulate(Rperf* rp);
+
+/* prints the accumulated counts, e.g.
+   [cyc 1.2e+06 ins 2.1e+06 ipc 1.75 l1d-miss 1.3e+04 llc-miss 210 br-miss 3.4e+03]
+   followed by the share of the time they were measured over if the
+   group was multiplexed, e.g. run 80% */
+char* rp_sprint(char* buf, Rperf rp);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* RTIMER_H */
@@ -0,0 +1,401 @@
+#include "segindex.h"
+#include <algorithm>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+
+/* rounds offset up to a multiple of 8 */
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+
+/* Points the fields of idx into the image, which must hold a valid header */
+static void si_attach(segIndex* idx) {
+    const char* base = (const char*)idx->image;
+    const siHeader* h = (const siHeader*)base;
+
+    idx->header = h;
+    idx->events = (const event*)(base + h->eventsOffset);
+    idx->nbEvents = h->nbEvents;
+    idx->xs = (const int*)(base + h->xsOffset);
+    idx->nbXs = h->nbXs;
+    idx->nbLeaves = h->nbLeaves;
+    idx->nodeStart = (const uint64_t*)(base + h->nodeStartOffset);
+    idx->ys = (const int*)(base + h->ysOffset);
+    idx->ids = (const int*)(base + h->idsOffset);
+    idx->wc.ys = (const int*)(base + h->wcYsOffset);
+    idx->wc.nbYs = h->wcNbYs;
+    idx->wc.versionX = (const int*)(base + h->wcVersionXOffset);
+    idx->wc.versionRoot = (const int64_t*)(base + h->wcVersionRootOffset);
+    idx->wc.nbVersions = h->wcNbVersions;
+    idx->wc.nodes = (const wcNode*)(base + h->wcNodesOffset);
+    idx->wc.nbNodes = h->wcNbNodes;
+}
+
+
+/* **************************************** */
+/* Rank of an event among the events with the same x: start, vertical, end */
+static int eventRank(char eventType) {
+    return eventType == 'S' ? 0 : (eventType == 'V' ? 1 : 2);
+}
+
+bool event_before(const event& first, const event& second) {
+    if (first.eventXCoord != second.eventXCoord) {
+        return first.eventXCoord < second.eventXCoord;
+    }
+    return eventRank(first.eventType) < eventRank(second.eventType);
+}
+
+
+/* **************************************** */
+void create_events(const vector<segment2D>& segments,
+                   const vector<char>* alive, vector<event>* events) {
+    for (size_t i = 0; i < segments.size(); i++) {
+        if (alive && !(*alive)[i]) continue;
+        const segment2D& seg = segments[i];
+        event e;
+        memset(&e, 0, sizeof(e));
+        e.segment = seg;
+        e.segmentId = (int)i;
+        if (is_horizontal(seg)) {
+            e.eventType = 'S';
+            e.eventXCoord = min(seg.start.x, seg.end.x);
+            events->push_back(e);
+            e.eventType = 'E';
+            e.eventXCoord = max(seg.start.x, seg.end.x);
+            events->push_back(e);
+        } else {
+            e.eventType = 'V';
+            e.eventXCoord = seg.start.x;
+            events->push_back(e);
+        }
+    }
+}
+
+
+/* Index of x in the distinct x-endpoints */
+static int xRank(const vector<int>& xs, int x) {
+    return (int)(lower_bound(xs.begin(), xs.end(), x) - xs.begin());
+}
+
+
+/* Calls f on the canonical nodes of the leaf range [l, r] of a tree with
+   nbLeaves leaves, bottom-up */
+template <class F>
+static void forCanonicalNodes(size_t nbLeaves, size_t l, size_t r, F f) {
+    for (l += nbLeaves, r += nbLeaves + 1; l < r; l >>= 1, r >>= 1) {
+        if (l & 1) f(l++);
+        if (r & 1) f(--r);
+    }
+}
+
+
+/* **************************************** */
+int si_build(segIndex* idx, const vector<event>& events,
+             const vector<segment2D>& segments, const vector<char>* alive,
+             bool windowCounter) {
+
+    memset(idx, 0, sizeof(segIndex));
+
+    //Distinct x-endpoints of the horizontals, and the horizontals by increasing y so that every node list comes out sorted
+    vector<int> xs;
+    vector<int> byY;
+    for (size_t i = 0; i < segments.size(); i++) {
+        if (is_horizontal(segments[i]) && (!alive || (*alive)[i])) {
+            xs.push_back(segments[i].start.x);
+            xs.push_back(segments[i].end.x);
+            byY.push_back((int)i);
+        }
+    }
+    sort(xs.begin(), xs.end());
+    xs.erase(unique(xs.begin(), xs.end()), xs.end());
+    stable_sort(byY.begin(), byY.end(), [&](int a, int b) {
+        return segments[a].start.y < segments[b].start.y;
+    });
+
+    size_t nbSlots = xs.empty() ? 1 : 2 * xs.size() - 1;
+    size_t nbLeaves = 1;
+    while (nbLeaves < nbSlots) nbLeaves <<= 1;
+
+    //Leaf range of every horizontal
+    vector<size_t> first(segments.size()), last(segments.size());
+    for (size_t k = 0; k < byY.size(); k++) {
+        const segment2D& s = segments[byY[k]];
+        first[byY[k]] = 2 * xRank(xs, min(s.start.x, s.end.x));
+        last[byY[k]] = 2 * xRank(xs, max(s.start.x, s.end.x));
+    }
+
+    //Count the entries of each node, then turn the counts into start offsets
+    vector<uint64_t> nodeStart(2 * nbLeaves + 1, 0);
+    for (size_t k = 0; k < byY.size(); k++) {
+        forCanonicalNodes(nbLeaves, first[byY[k]], last[byY[k]],
+                          [&](size_t node) { nodeStart[node + 1]++; });
+    }
+    for (size_t i = 1; i < nodeStart.size(); i++) {
+        nodeStart[i] += nodeStart[i - 1];
+    }
+    uint64_t nbEntries = nodeStart.back();
+
+    wcData wc;
+    if (windowCounter) {
+        wc_build(&wc, events);
+    }
+
+    //Lay out the image
+    siHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SI_MAGIC, sizeof(h.magic));
+    h.version = SI_VERSION;
+    h.eventSize = sizeof(event);
+    h.wcNodeSize = sizeof(wcNode);
+    h.nbEvents = events.size();
+    h.nbXs = xs.size();
+    h.nbLeaves = nbLeaves;
+    h.nbEntries = nbEntries;
+    h.eventsOffset = align8(sizeof(siHeader));
+    h.xsOffset = align8(h.eventsOffset + h.nbEvents * sizeof(event));
+    h.nodeStartOffset = align8(h.xsOffset + h.nbXs * sizeof(int));
+    h.ysOffset = align8(h.nodeStartOffset + nodeStart.size() * sizeof(uint64_t));
+    h.idsOffset = align8(h.ysOffset + nbEntries * sizeof(int));
+    h.wcNbYs = wc.ys.size();
+    h.wcNbVersions = wc.versionX.size();
+    h.wcNbNodes = wc.nodes.size();
+    h.wcYsOffset = align8(h.idsOffset + nbEntries * sizeof(int));
+    h.wcVersionXOffset = align8(h.wcYsOffset + h.wcNbYs * sizeof(int));
+    h.wcVersionRootOffset = align8(h.wcVersionXOffset + h.wcNbVersions * sizeof(int));
+    h.wcNodesOffset = align8(h.wcVersionRootOffset + h.wcNbVersions * sizeof(int64_t));
+    h.imageSize = align8(h.wcNodesOffset + h.wcNbNodes * sizeof(wcNode));
+
+    char* image = (char*)calloc(1, h.imageSize);
+    if (image == NULL) {
+        fprintf(stderr, "si_build: cannot allocate %llu bytes\n", (unsigned long long)h.imageSize);
+        return -1;
+    }
+    memcpy(image, &h, sizeof(h));
+    if (!events.empty()) {
+        memcpy(image + h.eventsOffset, &events[0], h.nbEvents * sizeof(event));
+    }
+    if (!xs.empty()) {
+        memcpy(image + h.xsOffset, &xs[0], h.nbXs * sizeof(int));
+    }
+    memcpy(image + h.nodeStartOffset, &nodeStart[0], nodeStart.size() * sizeof(uint64_t));
+    if (!wc.ys.empty()) {
+        memcpy(image + h.wcYsOffset, &wc.ys[0], h.wcNbYs * sizeof(int));
+    }
+    if (!wc.versionX.empty()) {
+        memcpy(image + h.wcVersionXOffset, &wc.versionX[0], h.wcNbVersions * sizeof(int));
+        memcpy(image + h.wcVersionRootOffset, &wc.versionRoot[0], h.wcNbVersions * sizeof(int64_t));
+    }
+    if (!wc.nodes.empty()) {
+        memcpy(image + h.wcNodesOffset, &wc.nodes[0], h.wcNbNodes * sizeof(wcNode));
+    }
+
+    //Fill the node lists in y order
+    int* ys = (int*)(image + h.ysOffset);
+    int* ids = (int*)(image + h.idsOffset);
+    vector<uint64_t> fill(nodeStart.begin(), nodeStart.end() - 1);
+    for (size_t k = 0; k < byY.size(); k++) {
+        int id = byY[k];
+        forCanonicalNodes(nbLeaves, first[id], last[id], [&](size_t node) {
+            ys[fill[node]] = segments[id].start.y;
+            ids[fill[node]] = id;
+            fill[node]++;
+        });
+    }
+
+    idx->image = image;
+    idx->imageSize = h.imageSize;
+    idx->mapped = 0;
+    si_attach(idx);
+    return 0;
+}
+
+
+/* **************************************** */
+int si_save(const segIndex* idx, const char* path) {
+
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    if (fwrite(idx->image, 1, idx->imageSize, f) != idx->imageSize) {
+        perror(path);
+        fclose(f);
+        return -1;
+    }
+    if (fclose(f) != 0) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+
+/* 1 if count items of size bytes at offset lie inside an image of
+   imageSize bytes, on 8 bytes */
+static bool si_fits(uint64_t offset, uint64_t count, size_t size, uint64_t imageSize) {
+    return offset % 8 == 0 && offset <= imageSize && count <= (imageSize - offset) / size;
+}
+
+
+/* Error message if the sections of the image in h are out of its
+   bounds, else NULL. This only reads the header and the two ends of
+   the node offsets, so a load stays O(1); the offsets in between are
+   clamped when they are used */
+static const char* si_check(const siHeader* h) {
+    uint64_t size = h->imageSize;
+    if (h->eventsOffset < sizeof(siHeader)
+        || !si_fits(h->eventsOffset, h->nbEvents, sizeof(event), size)
+        || !si_fits(h->xsOffset, h->nbXs, sizeof(int), size)
+        || !si_fits(h->ysOffset, h->nbEntries, sizeof(int), size)
+        || !si_fits(h->idsOffset, h->nbEntries, sizeof(int), size)
+        || !si_fits(h->wcYsOffset, h->wcNbYs, sizeof(int), size)
+        || !si_fits(h->wcVersionXOffset, h->wcNbVersions, sizeof(int), size)
+        || !si_fits(h->wcVersionRootOffset, h->wcNbVersions, sizeof(int64_t), size)
+        || !si_fits(h->wcNodesOffset, h->wcNbNodes, sizeof(wcNode), size)) {
+        return "index section out of the file";
+    }
+    //every x needs its two leaves, and a window counter without nodes has nothing else
+    if (h->nbLeaves == 0 || (h->nbLeaves & (h->nbLeaves - 1)) != 0
+        || h->nbLeaves > size || (h->nbXs > 0 && 2 * h->nbXs - 1 > h->nbLeaves)
+        || (h->wcNbNodes == 0 && (h->wcNbYs != 0 || h->wcNbVersions != 0))) {
+        return "corrupt index header";
+    }
+    if (!si_fits(h->nodeStartOffset, 2 * h->nbLeaves + 1, sizeof(uint64_t), size)) {
+        return "index section out of the file";
+    }
+    const uint64_t* nodeStart = (const uint64_t*)((const char*)h + h->nodeStartOffset);
+    if (nodeStart[0] != 0 || nodeStart[2 * h->nbLeaves] != h->nbEntries) {
+        return "corrupt index tree";
+    }
+    return NULL;
+}
+
+
+/* **************************************** */
+int si_load(segIndex* idx, const char* path) {
+
+    memset(idx, 0, sizeof(segIndex));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(siHeader)) {
+        fprintf(stderr, "%s: not an index file\n", path);
+        close(fd);
+        return -1;
+    }
+    void* image = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        perror(path);
+        return -1;
+    }
+
+    const siHeader* h = (const siHeader*)image;
+    const char* error = NULL;
+    if (memcmp(h->magic, SI_MAGIC, sizeof(h->magic)) != 0) {
+        error = "not an index file";
+    } else if (h->version != SI_VERSION) {
+        error = "unsupported index version";
+    } else if (h->eventSize != sizeof(event) || h->wcNodeSize != sizeof(wcNode)) {
+        error = "index written with a different event or node layout";
+    } else if (h->imageSize > (uint64_t)st.st_size) {
+        error = "truncated index file";
+    } else {
+        error = si_check(h);
+    }
+    if (error != NULL) {
+        fprintf(stderr, "%s: %s\n", path, error);
+        munmap(image, st.st_size);
+        return -1;
+    }
+
+    idx->image = image;
+    idx->imageSize = st.st_size;
+    idx->mapped = 1;
+    si_attach(idx);
+    return 0;
+}
+
+
+/* **************************************** */
+void si_close(segIndex* idx) {
+    if (idx->image != NULL) {
+        if (idx->mapped) {
+            munmap(idx->image, idx->imageSize);
+        } else {
+            free(idx->image);
+        }
+    }
+    memset(idx, 0, sizeof(segIndex));
+}
+
+
+/* Leaf of the tree that contains x, or -1 if no horizontal spans x */
+static long si_leaf(const segIndex* idx, int x) {
+    const int* xs = idx->xs;
+    size_t j = lower_bound(xs, xs + idx->nbXs, x) - xs;
+    if (j < idx->nbXs && xs[j] == x) return 2 * j;
+    if (j == 0 || j == idx->nbXs) return -1;
+    return 2 * j - 1;
+}
+
+
+/* Calls f(begin, end) on the entries with y1<=y<=y2 of every node on
+   the path from the leaf containing x to the root */
+template <class F>
+static void si_walk(const segIndex* idx, int x, int y1, int y2, F f) {
+    if (y1 > y2) swap(y1, y2);
+    long leaf = si_leaf(idx, x);
+    if (leaf < 0) return;
+    uint64_t nbEntries = idx->header->nbEntries;
+    for (size_t node = leaf + idx->nbLeaves; node >= 1; node >>= 1) {
+        //the offsets of a mapped image were not checked when it was loaded
+        uint64_t first = min(idx->nodeStart[node], nbEntries);
+        uint64_t last = min(idx->nodeStart[node + 1], nbEntries);
+        if (first >= last) continue;
+        const int* lo = idx->ys + first;
+        const int* hi = idx->ys + last;
+        const int* b = lower_bound(lo, hi, y1);
+        const int* e = upper_bound(b, hi, y2);
+        if (b != e) f(b - idx->ys, e - idx->ys);
+    }
+}
+
+
+/* **************************************** */
+size_t si_report(const segIndex* idx, int x, int y1, int y2, vector<int>* out) {
+    size_t k = 0;
+    si_walk(idx, x, y1, y2, [&](size_t b, size_t e) {
+        out->insert(out->end(), idx->ids + b, idx->ids + e);
+        k += e - b;
+    });
+    return k;
+}
+
+
+/* **************************************** */
+size_t si_count(const segIndex* idx, int x, int y1, int y2) {
+    size_t k = 0;
+    si_walk(idx, x, y1, y2, [&](size_t b, size_t e) { k += e - b; });
+    return k;
+}
@@ -0,0 +1,134 @@
+#ifndef __segindex_h
+#define __segindex_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "geom.h"
+#include "wincount.h"
+
+
+/* A prebuilt index over a set of segments: the sorted event array of
+   the sweep, plus a static segment tree over the x-extents of the
+   horizontal segments that answers "which horizontals does this
+   vertical cross" without sweeping, and optionally a window counter
+   that counts the intersections in a rectangle.
+
+   The index lives in one flat, pointer-free image that is written to
+   disk as is and mapped back with mmap, so loading it does no work
+   beyond validating the header and the bounds of the sections, in
+   O(1). The offsets and indices stored inside the sections are
+   checked where they are used.
+
+   Layout of the image (all offsets are from the start of the image
+   and 8-byte aligned):
+
+   siHeader
+   event     events[nbEvents]         sorted as the sweep consumes them
+   int       xs[nbXs]                 distinct x-endpoints of the horizontals
+   uint64_t  nodeStart[2*nbLeaves+1]  entries of node i are [nodeStart[i], nodeStart[i+1])
+   int       ys[nbEntries]            y of each entry, sorted within a node
+   int       ids[nbEntries]           segment id of each entry
+   int       wcYs[wcNbYs]             the window counter (see wincount.h),
+   int       wcVersionX[wcNbVersions]  empty if wcNbNodes == 0
+   int64_t   wcVersionRoot[wcNbVersions]
+   wcNode    wcNodes[wcNbNodes]
+
+   The counter takes several times the space and the time of the rest
+   of the index, so it is only built for the indexes that count.
+
+   Leaf 2j of the tree is the point xs[j], leaf 2j+1 the open gap
+   between xs[j] and xs[j+1]. A horizontal is stored in the O(log n)
+   canonical nodes of its range of leaves, so the tree takes
+   O(n log n) space and a query takes O(log^2 n + k).
+ */
+
+#define SI_MAGIC "OSIINDEX"
+#define SI_VERSION 3
+
+typedef struct _siHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t eventSize; /* sizeof(event) of the writer; the image is not portable across layouts */
+  uint32_t wcNodeSize; /* sizeof(wcNode) of the writer */
+  uint32_t unused;
+  uint64_t imageSize;
+  uint64_t nbEvents;
+  uint64_t nbXs;
+  uint64_t nbLeaves; /* a power of two */
+  uint64_t nbEntries;
+  uint64_t eventsOffset;
+  uint64_t xsOffset;
+  uint64_t nodeStartOffset;
+  uint64_t ysOffset;
+  uint64_t idsOffset;
+  uint64_t wcNbYs;
+  uint64_t wcNbVersions;
+  uint64_t wcNbNodes; /* 0 if the index has no window counter */
+  uint64_t wcYsOffset;
+  uint64_t wcVersionXOffset;
+  uint64_t wcVersionRootOffset;
+  uint64_t wcNodesOffset;
+} siHeader;
+
+
+typedef struct _segIndex {
+  void* image; /* the mapping, or the malloc'ed image of a freshly built index */
+  size_t imageSize;
+  int mapped; /* 1 if image is an mmap, 0 if it was malloc'ed */
+
+  const siHeader* header;
+  const event* events;
+  size_t nbEvents;
+  const int* xs;
+  size_t nbXs;
+  size_t nbLeaves;
+  const uint64_t* nodeStart;
+  const int* ys;
+  const int* ids;
+  windowCounter wc;
+} segIndex;
+
+
+/* order of the events in the sweep: by x, and at the same x horizontal
+   segments start before the verticals and end after them, so that
+   segments that only touch intersect */
+bool event_before(const event& first, const event& second);
+
+/* appends to events two events for every horizontal segment (start,
+   end) and one for every vertical, skipping the ids i with alive[i]
+   == 0 if alive is not NULL. The events are not sorted */
+void create_events(const std::vector<segment2D>& segments,
+                   const std::vector<char>* alive, std::vector<event>* events);
+
+
+/* builds the image in memory from the sorted events and the segments
+   they were created from; the id of a segment is its position in
+   segments, and if alive is not NULL only the ids with alive[i] != 0
+   are indexed. The window counter is only built if windowCounter is
+   true. Returns 0 on success, -1 on failure */
+int si_build(segIndex* idx, const std::vector<event>& events,
+             const std::vector<segment2D>& segments,
+             const std::vector<char>* alive = NULL, bool windowCounter = false);
+
+/* writes the image to path. Returns 0 on success, -1 on failure */
+int si_save(const segIndex* idx, const char* path);
+
+/* maps the image stored in path read-only. Returns 0 on success, -1
+   if the file cannot be mapped or is not a valid index of this
+   version */
+int si_load(segIndex* idx, const char* path);
+
+/* unmaps or frees the image */
+void si_close(segIndex* idx);
+
+
+/* appends to out the ids of the horizontal segments that intersect the
+   vertical segment x=x, y1<=y<=y2 (in any order); returns how many */
+size_t si_report(const segIndex* idx, int x, int y1, int y2, std::vector<int>* out);
+
+/* returns the number of horizontal segments that intersect the
+   vertical segment x=x, y1<=y<=y2 */
+size_t si_count(const segIndex* idx, int x, int y1, int y2);
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef __sweepkernel_h
+#define __sweepkernel_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+#include "geom.h"
+#include "denseactive.h"
+#include "ostree.h"
+
+
+/* The sweep over sorted events as a template over what it keeps the
+   active horizontals in and what it does with the intersections, for
+   runs that only need the result and not the viewer's state.
+
+   The active structure and the output are resolved at compile time
+   through overloads of ka_* and ko_vertical, so each combination is
+   its own loop: the count kernel never enumerates, the points kernel
+   neither prints nor tests a mode, and only the kernels that report
+   ids keep them in the active structure.
+
+   Active structures, all keyed by the y of the horizontals:
+
+   sortedActive    an order-statistic tree of y (see ostree.h), which
+                   counts a range in O(log n) without walking it
+   sortedIdActive  the same over (y, id), for the outputs that need ids
+   denseYActive    the counters and bitmaps of denseactive.h, for a
+                   small range of y
+
+   Outputs, called once per vertical:
+
+   countOutput     adds up the number of intersections
+   pointsOutput    appends the intersection points to a vector
+   pairsOutput     appends (horizontal id, vertical id) to a vector
+   callbackOutput  calls f(x, y, horizontal id, vertical id) on each
+                   intersection, the horizontal id being -1 if the
+                   active structure does not keep ids
+ */
+
+
+typedef struct _sortedActive {
+  osTree<int> ys;
+} sortedActive;
+
+typedef struct _sortedIdActive {
+  osTree<std::pair<int, int> > yids;
+} sortedIdActive;
+
+typedef struct _denseYActive {
+  denseActive da;
+} denseYActive;
+
+
+inline void ka_insert(sortedActive* as, int y, int id) { os_insert(&as->ys, y); }
+inline void ka_erase(sortedActive* as, int y, int id) { os_erase(&as->ys, y); }
+inline size_t ka_count(const sortedActive* as, int lo, int hi) { return os_count(&as->ys, lo, hi); }
+template <class F>
+void ka_report(const sortedActive* as, int lo, int hi, F f) {
+    os_report(&as->ys, lo, hi, [&](int y) { f(y, -1); });
+}
+
+inline void ka_insert(sortedIdActive* as, int y, int id) { os_insert(&as->yids, std::make_pair(y, id)); }
+inline void ka_erase(sortedIdActive* as, int y, int id) { os_erase(&as->yids, std::make_pair(y, id)); }
+inline size_t ka_count(const sortedIdActive* as, int lo, int hi) {
+    return os_count(&as->yids, std::make_pair(lo, INT32_MIN), std::make_pair(hi, INT32_MAX));
+}
+template <class F>
+void ka_report(const sortedIdActive* as, int lo, int hi, F f) {
+    os_report(&as->yids, std::make_pair(lo, INT32_MIN), std::make_pair(hi, INT32_MAX),
+              [&](const std::pair<int, int>& yid) { f(yid.first, yid.second); });
+}
+
+inline void ka_insert(denseYActive* as, int y, int id) { da_insert(&as->da, y); }
+inline void ka_erase(denseYActive* as, int y, int id) { da_erase(&as->da, y); }
+inline size_t ka_count(const denseYActive* as, int lo, int hi) { return da_count(&as->da, lo, hi); }
+template <class F>
+void ka_report(const denseYActive* as, int lo, int hi, F f) {
+    da_report(&as->da, lo, hi, [&](int y) { f(y, -1); });
+}
+
+
+typedef struct _countOutput {
+  uint64_t k;
+} countOutput;
+
+typedef struct _pointsOutput {
+  std::vector<point2D>* points;
+} pointsOutput;
+
+typedef struct _pairsOutput {
+  std::vector<std::pair<int, int> >* pairs;
+} pairsOutput;
+
+template <class F>
+struct callbackOutput {
+  F f;
+};
+
+
+template <class Active>
+void ko_vertical(countOutput* out, const Active* as, int x, int lo, int hi, int id) {
+    out->k += ka_count(as, lo, hi);
+}
+
+template <class Active>
+void ko_vertical(pointsOutput* out, const Active* as, int x, int lo, int hi, int id) {
+    std::vector<point2D>* points = out->points;
+    ka_report(as, lo, hi, [&](int y, int hid) {
+        point2D p = {x, y};
+        points->push_back(p);
+    });
+}
+
+/* only for the active structures that keep ids */
+inline void ko_vertical(pairsOutput* out, const sortedIdActive* as, int x, int lo, int hi, int id) {
+    std::vector<std::pair<int, int> >* pairs = out->pairs;
+    ka_report(as, lo, hi, [&](int y, int hid) { pairs->push_back(std::make_pair(hid, id)); });
+}
+
+template <class F, class Active>
+void ko_vertical(callbackOutput<F>* out, const Active* as, int x, int lo, int hi, int id) {
+    ka_report(as, lo, hi, [&](int y, int hid) { out->f(x, y, hid, id); });
+}
+
+
+/* sweeps events[first, last), which are sorted by event_before, from
+   the state in as, handing every vertical to out. The starts, ends and
+   verticals have to be handled in that one order, so the switch stays:
+   split into three streams they would need a merge, with the same
+   branch per event */
+template <class Active, class Output>
+void sweep_kernel(const event* events, size_t first, size_t last, Active* as, Output* out) {
+    for (size_t i = first; i < last; i++) {
+        const event& e = events[i];
+        switch (e.eventType) {
+        case 'S':
+            ka_insert(as, e.segment.start.y, e.segmentId);
+            break;
+        case 'E':
+            ka_erase(as, e.segment.start.y, e.segmentId);
+            break;
+        default: {
+            int lo = e.segment.start.y, hi = e.segment.end.y;
+            if (lo > hi) std::swap(lo, hi);
+            ko_vertical(out, as, e.segment.start.x, lo, hi, e.segmentId);
+        }
+        }
+    }
+}
+
+#endif
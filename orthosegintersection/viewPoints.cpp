@@ -11,12 +11,27 @@
  */
 #include <set>
 #include <vector>
+#include <algorithm>
 #include "geom.h"
 #include "rtimer.h"
+#include "segindex.h"
+#include "liveindex.h"
+#include "daemon.h"
+#include "checkpoint.h"
+#include "denseactive.h"
+#include "sweepkernel.h"
+#include "ostree.h"
+#include "estimate.h"
+#include "join.h"
+#include "concbench.h"
+#include "colstore.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 #include <assert.h>
+#include <string.h>
+#include <limits.h>
+#include <thread>
 #ifdef __APPLE__
 #include <GLUT/glut.h>
 #else
@@ -33,12 +48,6 @@ struct yCoordinate {
     }
 };
 
-//Comparator for auxiliary active structure containing only y-coordinate ints
-struct yCoordinateInt{
-    bool operator() (const int& first, const int& second) const{
-        return first < second;
-    }
-};
 
 
 
@@ -62,6 +71,7 @@ GLint fillmode = 0;
 void display(void);
 void keypress(unsigned char key, int x, int y);
 void timerfunc();
+void mouse(int button, int state, int x, int y);
 void drawCircle(float cx, float cy, float r, int num_segments);
 
 
@@ -107,9 +117,16 @@ multiset<segment2D,yCoordinate> as;
 
 //the auxiliary active structure that stores the y-coordinates of the segments intersecting the sweep line
 //This is only used because a given multiset cannot be searched through by a type, such as an int in this case, that is different from the type used during the initial declaration (a segment2D in our case).
-multiset<int,yCoordinateInt> asY;
-//Interator for the active structures
-multiset<int,yCoordinateInt>::iterator itlow,itup;
+//It is an order-statistic tree (see ostree.h) so that counting the ones a vertical crosses does not walk them
+osTree<int> asY;
+
+//When the horizontals span a small range of y, their y-coordinates are kept in this bitmap structure instead of asY (see denseactive.h)
+denseActive asDense;
+bool useDense = false;
+
+//Which of asY and asDense to use: chosen from the range of y, or forced by the user
+enum { ACTIVE_AUTO, ACTIVE_SORTED, ACTIVE_DENSE };
+int activeChoice = ACTIVE_AUTO;
 
 //the events
 vector<event> events;
@@ -117,6 +134,84 @@ vector<event> events;
 //Keeps track of last event looked at to prevent unnecessary repeat iterations
 int lastEventScanned = 0;
 
+//Phases of a run that are timed separately
+enum { PHASE_INIT, PHASE_EVENTS, PHASE_SWEEP, NB_PHASES };
+const char* phaseNames[NB_PHASES] = {"init", "events", "sweep"};
+
+//Wall/user/system time and hardware counters of each phase, accumulated over all the start/stop pairs of the phase
+Rtimer phaseTimer[NB_PHASES];
+Rperf phasePerf[NB_PHASES];
+RperfGroup perfGroup;
+
+//Set once the sweep has passed the last event and the phases have been reported
+bool sweepDone = false;
+
+//Snapshots of the sweep taken every checkpointEvery events, to jump to any x and back
+checkpointLog checkpoints;
+int checkpointEvery = 1024;
+
+//Checkpoints kept in memory: all of them for the viewer, only the last one for a batch run
+size_t checkpointsKept = 0;
+
+//A batch run rewrites its resume file at most once in this many microseconds, and last did at lastCheckpointSave
+#define CHECKPOINT_SAVE_USEC 1000000
+double lastCheckpointSave = 0;
+
+//Set while the user scrubs through the sweep, which stops the animation
+bool paused = false;
+
+//Intersections found before the checkpoint a batch run resumed from, which are not in intpoints
+uint64_t intpointsOffset = 0;
+
+//Intersections to the left of the sweep line; after scrubbing backwards intpoints still holds the ones further right
+size_t intpointsSwept = 0;
+
+//Where a batch run saves its checkpoints, or NULL
+const char* resumePath = NULL;
+uint64_t eventsChecksum = 0;
+
+//What the sweep does with the intersections: print and keep them, only keep them in intpoints, or only count them.
+//A batch run in OUTPUT_AUTO picks one from an estimate of their number (see estimate.h)
+enum { OUTPUT_ENUMERATE, OUTPUT_COMPACT, OUTPUT_COUNT, OUTPUT_AUTO };
+const char* outputNames[] = {"enumerate", "compact", "count"};
+int batchOutput = OUTPUT_ENUMERATE;
+
+//Limits of OUTPUT_AUTO: the number of intersections worth printing, and the memory intpoints may take
+#define ENUMERATE_MAX 1000000
+size_t outputMemory = (size_t)1 << 30;
+
+
+/* Zero the timers of all phases, and open the counters they share */
+void init_phases() {
+    rp_group_open(&perfGroup);
+    for (int p = 0; p < NB_PHASES; p++) {
+        rt_zero(phaseTimer[p]);
+        rp_init(&phasePerf[p], &perfGroup);
+    }
+    if (!phasePerf[0].enabled) {
+        fprintf(stderr, "hardware counters not available, timing only\n");
+    }
+}
+
+void phase_start(int p) {
+    rt_start(phaseTimer[p]);
+    rp_start(&phasePerf[p]);
+}
+
+void phase_stop(int p) {
+    rp_stop_and_accumulate(&phasePerf[p]);
+    rt_stop_and_accumulate(phaseTimer[p]);
+}
+
+/* Print time and counters of each phase */
+void print_phases() {
+    char tbuf[256], pbuf[512];
+    for (int p = 0; p < NB_PHASES; p++) {
+        printf("%-6s %s %s\n", phaseNames[p],
+               rt_sprint_total(tbuf, phaseTimer[p]), rp_sprint(pbuf, phasePerf[p]));
+    }
+}
+
 
 //Generic openGL draw circle method
 void drawCircle(float cx, float cy, float r, int num_segments)
@@ -144,12 +239,9 @@ void drawCircle(float cx, float cy, float r, int num_segments)
 
 
 
-/*Comparator for events vector*/
-bool comp(const event& first, const event& second) { return first.eventXCoord < second.eventXCoord; }
-
 /*Called to sort the events vector*/
 void sortEvents() {
-    sort(events.begin(), events.end(), comp);
+    sort(events.begin(), events.end(), event_before);
 }
 
 /* Called before sweeping line begins moving to add all events from the 
@@ -158,39 +250,129 @@ void sortEvents() {
  * and one for a vertical segment. Events are indexed by their x-coordinate
  */
 void creatEvents() {
-    
-    for (int i=0; i<segments.size(); i++) {
-        event e1;
-        event e2;
-        segment2D seg = segments[i];
-        if(seg.start.x != seg.end.x){
-            //Segment start event
-            e1.segment = seg;
-            e1.eventType = 'S';
-            e1.eventXCoord = seg.start.x;
-            events.push_back(e1);
-            //Segment end event
-            e2.segment = seg;
-            e2.eventType = 'E';
-            e2.eventXCoord = seg.end.x;
-            events.push_back(e2);
-            
-        }else{//Else segement is vertical so create one event
-            e1.segment = seg;
-            e1.eventType = 'V';
-            e1.eventXCoord = seg.start.x;
-            events.push_back(e1);
+    create_events(segments, NULL, &events);
+}
+
+/* Snapshot the sweep if enough events have been handled since the last
+   checkpoint; a batch run only does when it is time to save one */
+void take_checkpoint() {
+    if (!cp_due(&checkpoints, lastEventScanned)) {
+        return;
+    }
+    bool batchRun = checkpointsKept == 1;
+    if (batchRun && (!resumePath || rt_now_usec() - lastCheckpointSave < CHECKPOINT_SAVE_USEC)) {
+        //copying the active structure costs O(n) and the snapshot would not be saved
+        cp_skip(&checkpoints, lastEventScanned);
+        return;
+    }
+    sweepCheckpoint cp;
+    cp.eventIndex = lastEventScanned;
+    cp.sweepX = sweep_line_x;
+    cp.nbIntersections = intpointsOffset + intpointsSwept;
+    cp.active.assign(as.begin(), as.end());
+    cp_record(&checkpoints, cp);
+    if (batchRun) {
+        cp_save(&cp, eventsChecksum, resumePath);
+        lastCheckpointSave = rt_now_usec();
+    }
+}
+
+/* Pick asDense over asY if the horizontals fit in a small range of y, and empty both */
+void init_active_structure() {
+    int ymin = 0, ymax = -1;
+    for (size_t i = 0; i < events.size(); i++) {
+        if (events[i].eventType != 'S') continue;
+        int y = events[i].segment.start.y;
+        if (ymax < ymin) {
+            ymin = ymax = y;
+        } else {
+            ymin = min(ymin, y);
+            ymax = max(ymax, y);
         }
-        
     }
-    
+    bool small = ymax < ymin || (long)ymax - ymin < DENSE_MAX_UNIVERSE;
+    if (activeChoice == ACTIVE_DENSE && !small) {
+        fprintf(stderr, "y-range too large for the dense active structure, using a sorted tree\n");
+    }
+    useDense = activeChoice != ACTIVE_SORTED && small;
+    if (useDense) {
+        da_init(&asDense, ymax < ymin ? 0 : ymin, ymax < ymin ? 0 : ymax);
+    }
+    os_clear(&asY);
 }
 
-void timerfunc() {
-    
+/* Add or remove the y-coordinate of an active horizontal */
+void active_insert(int y) {
+    if (useDense) {
+        da_insert(&asDense, y);
+    } else {
+        os_insert(&asY, y);
+    }
+}
+
+void active_erase(int y) {
+    if (useDense) {
+        da_erase(&asDense, y);
+    } else {
+        os_erase(&asY, y);
+    }
+}
+
+/* Record the intersection of the vertical at x with the horizontal at y */
+void report_intersection(int x, int y, bool verbose) {
+    if (verbose) {
+        printf("Intersection: (%i,%d)\n",x,y);
+    }
+    point2D intersect;
+    intersect.x = x;
+    intersect.y = y;
+    //the intersection may already be there from before a rewind
+    if (intpointsSwept == intpoints.size()) {
+        intpoints.push_back(intersect);
+    }
+    intpointsSwept++;
+}
+
+/* Put the sweep back in the state of checkpoint cp */
+void restore_checkpoint(const sweepCheckpoint* cp) {
+    as.clear();
+    if (useDense) {
+        da_clear(&asDense);
+    } else {
+        os_clear(&asY);
+    }
+    for (size_t i = 0; i < cp->active.size(); i++) {
+        as.insert(cp->active[i]);
+        active_insert(cp->active[i].start.y);
+    }
+    assert(cp->nbIntersections >= intpointsOffset);
+    intpointsSwept = cp->nbIntersections - intpointsOffset;
+    assert(intpointsSwept <= intpoints.size());
+    lastEventScanned = cp->eventIndex;
+    sweep_line_x = cp->sweepX;
+    sweepDone = false;
+}
+
+/* Start the sweep over from the first event, forgetting all the checkpoints */
+void restart_sweep() {
+    as.clear();
+    init_active_structure();
+    intpoints.clear();
+    intpointsOffset = 0;
+    intpointsSwept = 0;
+    lastEventScanned = 0;
+    sweep_line_x = events.empty() ? 0 : min(0, events[0].eventXCoord);
+    sweepDone = false;
+    cp_init(&checkpoints, checkpointEvery, checkpointsKept);
+    take_checkpoint();
+}
+
+/* Handle all the events at the sweep line, doing with the intersections what output says, and move the line one to the right */
+void sweep_step(int output) {
+    bool verbose = output == OUTPUT_ENUMERATE;
     //Iterate from the last element/event looked at until it reaches elements/events that have an equal x-coordinate to the current sweep line position
     int i;
-    for (i = lastEventScanned; events[i].eventXCoord == sweep_line_x; i++) {
+    for (i = lastEventScanned; i < (int)events.size() && events[i].eventXCoord == sweep_line_x; i++) {
 
         //Get event that the sweep line is currently on
         event e = events[i];
@@ -199,11 +381,11 @@ void timerfunc() {
             //Add segment to active structure
             as.insert(e.segment);
             //Add segemnt y-coordinate to aux active structure
-            asY.insert(e.segment.start.y);
+            active_insert(e.segment.start.y);
             
         }else if (e.eventType == 'E'){//If event is the end of a horizontal line segement
             //Remove segment from active structure
-            asY.erase(asY.find(e.segment.start.y));
+            active_erase(e.segment.start.y);
             //Remove from aux as the y coordinate associated with segement being removed
             as.erase(as.find(e.segment));
         }else{//If event is the a vertical line segement
@@ -218,27 +400,189 @@ void timerfunc() {
                 end= temp;
             }
             
-            //Get iterators for multiset from two y-coord bounds
-            itlow = asY.lower_bound(start);
-            itup = asY.upper_bound(end);
-            
-            //Using iterators add all intersections formed from this vertical line and appropriate horizontal lines in the active structure.
-            for (multiset<int,yCoordinateInt>::iterator it = itlow; it != itup; ++it){
-                printf("Intersection: (%i,%d)\n",e.segment.start.x,*it);
-                point2D intersect;
-                intersect.x = e.segment.start.x;
-                intersect.y = *it;
-                intpoints.push_back(intersect);
-                
+            int x = e.segment.start.x;
+            if (output == OUTPUT_COUNT) {
+                //only how many horizontals the vertical crosses matters
+                if (useDense) {
+                    intpointsSwept += da_count(&asDense, start, end);
+                } else {
+                    intpointsSwept += os_count(&asY, start, end);
+                }
+            } else if (useDense) {
+                //Scan the occupied heights between the two bounds a word at a time
+                da_report(&asDense, start, end, [&](int y) { report_intersection(x, y, verbose); });
+            } else {
+                //Add all intersections formed from this vertical line and the horizontal lines in the active structure between the two y-coord bounds
+                os_report(&asY, start, end, [&](int y) { report_intersection(x, y, verbose); });
             }
         }
     }
-    
-    glutPostRedisplay();
     sweep_line_x++;
     //Set next starting location for loop
     lastEventScanned = i;
+    take_checkpoint();
+}
+
+/* Move the sweep line to x, handling the events before x: from the
+   last checkpoint before x when going backwards or far ahead, from
+   where the sweep is otherwise */
+void jump_to(int x) {
+    const sweepCheckpoint* cp = cp_before(&checkpoints, x);
+    if (cp == NULL) {
+        return;
+    }
+    if (sweep_line_x > x || cp->sweepX > sweep_line_x) {
+        restore_checkpoint(cp);
+    }
+    while (sweep_line_x < x) {
+        int next = lastEventScanned < (int)events.size() ? events[lastEventScanned].eventXCoord : x;
+        if (next > sweep_line_x) {
+            //nothing happens until the next event
+            sweep_line_x = min(next, x);
+        } else {
+            sweep_step(OUTPUT_COMPACT);
+        }
+    }
+}
+
+void timerfunc() {
     
+    if (paused) {
+        return;
+    }
+    //Once all the events are handled, report the phases and stop
+    if (lastEventScanned == (int)events.size()) {
+        if (!sweepDone) {
+            sweepDone = true;
+            printf("%llu intersections\n", (unsigned long long)(intpointsOffset + intpointsSwept));
+            print_phases();
+        }
+        return;
+    }
+    
+    phase_start(PHASE_SWEEP);
+    sweep_step(OUTPUT_ENUMERATE);
+    phase_stop(PHASE_SWEEP);
+    
+    glutPostRedisplay();
+}
+
+/* Estimate the number of intersections, choose the output of a batch
+   run from it if asked to, and make room in intpoints for them */
+void plan_output() {
+    kEstimate est;
+    est_intersections(segments, EST_SAMPLES, EST_BUDGET, 1.96, 1, &est);
+    fprintf(stderr, "estimated ");
+    est_print(stderr, &est);
+
+    size_t maxPoints = outputMemory / sizeof(point2D);
+    if (batchOutput == OUTPUT_AUTO) {
+        if (est.hi <= ENUMERATE_MAX) {
+            batchOutput = OUTPUT_ENUMERATE;
+        } else if (est.hi <= maxPoints) {
+            batchOutput = OUTPUT_COMPACT;
+        } else {
+            batchOutput = OUTPUT_COUNT;
+        }
+        fprintf(stderr, "output: %s\n", outputNames[batchOutput]);
+    }
+    if (batchOutput != OUTPUT_COUNT) {
+        //the upper bound, so that intpoints most likely never grows
+        intpoints.reserve(min((size_t)ceil(est.hi), maxPoints));
+    }
+}
+
+/* Run a sweep kernel over sorted events in memory */
+template <class Active, class Output>
+void sweep_source(const vector<event>* source, Active* active, Output* out) {
+    if (!source->empty()) {
+        sweep_kernel(&(*source)[0], 0, source->size(), active, out);
+    }
+}
+
+/* Run a sweep kernel over the events of a column file, as they are decoded */
+template <class Active, class Output>
+void sweep_source(csStream* source, Active* active, Output* out) {
+    vector<event> buf(CS_BLOCK_SIZE);
+    size_t n;
+    while ((n = cs_stream_read(source, &buf[0], buf.size())) > 0) {
+        sweep_kernel(&buf[0], 0, n, active, out);
+    }
+}
+
+/* Sweep all the events of source at once with the kernel of the batch
+   output and the active structure, which keeps none of the viewer's state */
+template <class Active, class Source>
+void batch_kernel(Source* source, Active* active) {
+    if (batchOutput == OUTPUT_COUNT) {
+        countOutput out = {0};
+        sweep_source(source, active, &out);
+        intpointsSwept = out.k;
+    } else if (batchOutput == OUTPUT_COMPACT) {
+        pointsOutput out = {&intpoints};
+        sweep_source(source, active, &out);
+        intpointsSwept = intpoints.size();
+    } else {
+        auto print = [](int x, int y, int hid, int vid) {
+            printf("Intersection: (%i,%d)\n", x, y);
+            point2D p = {x, y};
+            intpoints.push_back(p);
+        };
+        callbackOutput<decltype(print)> out = {print};
+        sweep_source(source, active, &out);
+        intpointsSwept = intpoints.size();
+    }
+}
+
+/* Sweep all the events without animating, for runs too big to watch.
+   With a resume file, the last checkpoint is saved there at most once
+   a second and a run that was interrupted goes on from it */
+void run_batch() {
+    sweepCheckpoint cp;
+    checkpointsKept = 1;
+    lastCheckpointSave = rt_now_usec();
+    if (resumePath) {
+        eventsChecksum = cp_events_checksum(events);
+    }
+    if (resumePath && cp_load(&cp, eventsChecksum, resumePath) == 0) {
+        fprintf(stderr, "resuming at x=%d, event %d of %d, %llu intersections so far\n",
+                cp.sweepX, cp.eventIndex, (int)events.size(),
+                (unsigned long long)cp.nbIntersections);
+        intpoints.clear();
+        intpointsOffset = cp.nbIntersections;
+        init_active_structure();
+        restore_checkpoint(&cp);
+        cp_init(&checkpoints, checkpointEvery, checkpointsKept);
+        cp_record(&checkpoints, cp);
+    } else {
+        restart_sweep();
+    }
+    plan_output();
+    
+    phase_start(PHASE_SWEEP);
+    if (!resumePath && useDense) {
+        //nothing to checkpoint, so no need for the state of sweep_step
+        denseYActive active;
+        da_init(&active.da, asDense.ymin, asDense.ymax);
+        batch_kernel(&events, &active);
+        lastEventScanned = events.size();
+    } else if (!resumePath) {
+        sortedActive active;
+        batch_kernel(&events, &active);
+        lastEventScanned = events.size();
+    }
+    while (lastEventScanned < (int)events.size()) {
+        sweep_line_x = max(sweep_line_x, events[lastEventScanned].eventXCoord);
+        sweep_step(batchOutput);
+    }
+    phase_stop(PHASE_SWEEP);
+    
+    printf("%llu intersections\n", (unsigned long long)(intpointsOffset + intpointsSwept));
+    print_phases();
+    if (resumePath) {
+        //the run is complete, the next one starts over
+        remove(resumePath);
+    }
 }
 
 //Draw all the elements in the active structure
@@ -261,7 +605,7 @@ void draw_active_structure() {
 void draw_intersection_points() {
     //set color
     glColor3fv(white);
-    for (int i =0; i < intpoints.size(); i++){
+    for (int i =0; i < (int)intpointsSwept; i++){
         drawCircle(intpoints[i].x, intpoints[i].y,1,20);
     }
 }
@@ -270,22 +614,518 @@ void draw_intersection_points() {
 
 
 
+/* Rebuild the segments and the sorted events from a prebuilt index so
+   that they can be animated. Returns 0 on success, -1 if an event has
+   no valid segment id */
+int load_from_index(const segIndex* idx) {
+    events.assign(idx->events, idx->events + idx->nbEvents);
+    segments.clear();
+    for (size_t i = 0; i < idx->nbEvents; i++) {
+        const event& e = idx->events[i];
+        if (e.eventType == 'E') continue;
+        if (e.segmentId < 0 || (size_t)e.segmentId >= idx->nbEvents) {
+            fprintf(stderr, "corrupt index: event of segment %d\n", e.segmentId);
+            return -1;
+        }
+        if (e.segmentId >= (int)segments.size()) {
+            segments.resize(e.segmentId + 1);
+        }
+        segments[e.segmentId] = e.segment;
+    }
+    n = segments.size();
+    return 0;
+}
+
+
+/* Answer one vertical query against a prebuilt index without sweeping */
+void query_index(const segIndex* idx, int x, int y1, int y2) {
+    vector<int> ids;
+    si_report(idx, x, y1, y2, &ids);
+    sort(ids.begin(), ids.end());
+    for (size_t i = 0; i < ids.size(); i++) {
+        printf("segment %d\n", ids[i]);
+    }
+    printf("%d intersections with x=%d, %d<=y<=%d\n", (int)ids.size(), x, y1, y2);
+}
+
+
+/* Count the intersections in a window without computing them */
+void count_window(const windowCounter* wc, int x1, int x2, int y1, int y2) {
+    Rtimer rt;
+    char buf[256];
+    rt_zero(rt);
+    rt_start(rt);
+    uint64_t k = wc_count(wc, x1, x2, y1, y2);
+    rt_stop(rt);
+    printf("%llu intersections in [%d,%d]x[%d,%d] %s\n", (unsigned long long)k,
+           x1, x2, y1, y2, rt_sprint(buf, rt));
+}
+
+
+/* Sweep the segments of a column file that touch [x1, x2], decoding
+   its blocks into events as the sweep goes and skipping the blocks out
+   of the range */
+int run_columns(const char* path, int x1, int x2) {
+    csFile cs;
+    phase_start(PHASE_EVENTS);
+    if (cs_open(&cs, path) != 0) {
+        return -1;
+    }
+    phase_stop(PHASE_EVENTS);
+    const csHeader* h = cs.header;
+    printf("%llu segments in %llu blocks, %.2f bytes per segment\n",
+           (unsigned long long)h->nbSegments, (unsigned long long)h->nbBlocks,
+           h->nbSegments ? (double)h->fileSize / h->nbSegments : 0.0);
+    
+    if (batchOutput == OUTPUT_AUTO) {
+        //there are no segments in memory to estimate from
+        batchOutput = OUTPUT_COUNT;
+    }
+    csStream st;
+    cs_stream_init(&st, &cs, x1, x2);
+    bool small = h->nbSegments == 0 || (long)h->maxY - h->minY < DENSE_MAX_UNIVERSE;
+    phase_start(PHASE_SWEEP);
+    if (activeChoice != ACTIVE_SORTED && small) {
+        denseYActive active;
+        da_init(&active.da, h->nbSegments ? h->minY : 0, h->nbSegments ? h->maxY : 0);
+        batch_kernel(&st, &active);
+    } else {
+        sortedActive active;
+        batch_kernel(&st, &active);
+    }
+    phase_stop(PHASE_SWEEP);
+    
+    printf("%llu intersections, %zu blocks read, %zu skipped\n",
+           (unsigned long long)intpointsSwept, st.blocksRead, st.blocksSkipped);
+    print_phases();
+    cs_close(&cs);
+    return 0;
+}
+
+/* Time one kernel, or the generic sweep, over all the events and print what it found */
+template <class Run>
+void time_kernel(const char* name, Run run) {
+    Rtimer rt;
+    char buf[128];
+    rt_zero(rt);
+    rt_start(rt);
+    uint64_t k = run();
+    rt_stop(rt);
+    printf("%-24s %12llu intersections %s\n", name, (unsigned long long)k, rt_sprint(buf, rt));
+}
+
+/* Compare the specialized sweep kernels with sweep_step, which decides
+   on the active structure and the output at every vertical */
+void run_kernel_bench() {
+    restart_sweep();
+    bool dense = useDense;
+    int ymin = asDense.ymin, ymax = asDense.ymax;
+    
+    if (!events.empty()) {
+        const event* ev = &events[0];
+        size_t nbEvents = events.size();
+        //the generic path keeps intpoints, the active segments and the checkpoints up to date;
+        //counting first tells how much room the kernels that keep the points need
+        vector<point2D> points;
+        vector<pair<int, int> > pairs;
+        for (int output = OUTPUT_COUNT; output >= OUTPUT_COMPACT; output--) {
+            for (int a = ACTIVE_SORTED; a <= ACTIVE_DENSE; a++) {
+                if (a == ACTIVE_DENSE && !dense) continue;
+                char name[64];
+                sprintf(name, "generic %s %s", outputNames[output], a == ACTIVE_DENSE ? "dense" : "sorted");
+                activeChoice = a;
+                time_kernel(name, [&]() {
+                    restart_sweep();
+                    while (lastEventScanned < (int)events.size()) {
+                        sweep_line_x = max(sweep_line_x, events[lastEventScanned].eventXCoord);
+                        sweep_step(output);
+                    }
+                    return (uint64_t)intpointsSwept;
+                });
+            }
+            if (output == OUTPUT_COUNT) {
+                intpoints.reserve(intpointsSwept);
+                points.reserve(intpointsSwept);
+                pairs.reserve(intpointsSwept);
+            }
+        }
+        intpoints.clear();
+        time_kernel("kernel count sorted", [&]() {
+            sortedActive as;
+            countOutput out = {0};
+            sweep_kernel(ev, 0, nbEvents, &as, &out);
+            return out.k;
+        });
+        time_kernel("kernel points sorted", [&]() {
+            sortedActive as;
+            pointsOutput out = {&points};
+            points.clear();
+            sweep_kernel(ev, 0, nbEvents, &as, &out);
+            return (uint64_t)points.size();
+        });
+        time_kernel("kernel pairs sorted", [&]() {
+            sortedIdActive as;
+            pairsOutput out = {&pairs};
+            pairs.clear();
+            sweep_kernel(ev, 0, nbEvents, &as, &out);
+            return (uint64_t)pairs.size();
+        });
+        if (dense) {
+            time_kernel("kernel count dense", [&]() {
+                denseYActive as;
+                da_init(&as.da, ymin, ymax);
+                countOutput out = {0};
+                sweep_kernel(ev, 0, nbEvents, &as, &out);
+                return out.k;
+            });
+            time_kernel("kernel points dense", [&]() {
+                denseYActive as;
+                da_init(&as.da, ymin, ymax);
+                pointsOutput out = {&points};
+                points.clear();
+                sweep_kernel(ev, 0, nbEvents, &as, &out);
+                return (uint64_t)points.size();
+            });
+            time_kernel("kernel callback dense", [&]() {
+                denseYActive as;
+                da_init(&as.da, ymin, ymax);
+                uint64_t k = 0;
+                auto hit = [&](int x, int y, int hid, int vid) { k++; };
+                callbackOutput<decltype(hit)> out = {hit};
+                sweep_kernel(ev, 0, nbEvents, &as, &out);
+                return k;
+            });
+        }
+    }
+}
+
+/* Join the horizontals of layer A with the verticals of layer B, writing the pairs to pairsPath if not NULL */
+int run_join(const char* pathA, const char* pathB, int nbThreads, const char* pairsPath) {
+    layerSource a, b;
+    Rtimer rt;
+    char buf[128];
+    
+    rt_zero(rt);
+    rt_start(rt);
+    if (ls_open(&a, pathA) != 0) {
+        return -1;
+    }
+    if (ls_open(&b, pathB) != 0) {
+        ls_close(&a);
+        return -1;
+    }
+    rt_stop(rt);
+    printf("layers of %zu and %zu segments, open %s\n", a.nbSegments, b.nbSegments, rt_sprint(buf, rt));
+    
+    vector<joinPair> pairs;
+    rt_zero(rt);
+    rt_start(rt);
+    rb_join(&a, &b, nbThreads, &pairs);
+    rt_stop(rt);
+    printf("%zu pairs with %d threads, join %s\n", pairs.size(), nbThreads, rt_sprint(buf, rt));
+    
+    int r = 0;
+    if (pairsPath) {
+        FILE* f = strcmp(pairsPath, "-") == 0 ? stdout : fopen(pairsPath, "w");
+        if (f == NULL) {
+            perror(pairsPath);
+            r = -1;
+        } else {
+            for (size_t i = 0; i < pairs.size(); i++) {
+                fprintf(f, "%d %d\n", pairs[i].a, pairs[i].b);
+            }
+            if (f != stdout && fclose(f) != 0) {
+                perror(pairsPath);
+                r = -1;
+            }
+        }
+    }
+    ls_close(&a);
+    ls_close(&b);
+    return r;
+}
+
+void usage() {
+    printf("usage: viewPoints <nbPoints> | -load <indexFile> [<mode>] [<options>]\n");
+    printf("       viewPoints -col <columnFile> [-xrange <x1> <x2>]\n");
+    printf("       viewPoints -join <layerA | -> <layerB | -> [-threads <t>] [-pairs <file | ->]\n");
+    printf("  the first form animates the sweep over nbPoints random segments, or over a saved index, unless given a mode;\n");
+    printf("  -col sweeps a column file and -join intersects two layers\n");
+    printf("modes:\n");
+    printf("  -save <indexFile>             with <nbPoints>, also writes the index (with a window counter if -window)\n");
+    printf("  -query <x> <y1> <y2>          with -load, prints the horizontals crossed by a vertical\n");
+    printf("  -daemon <socket | ->          serves queries and updates (see daemon.h)\n");
+    printf("  -window <x1> <x2> <y1> <y2>   counts the intersections in a window\n");
+    printf("  -batch [-resume <cpFile>]     sweeps without animating\n");
+    printf("  -estimate                     estimates the number of intersections\n");
+    printf("  -kernels                      times the sweep kernels\n");
+    printf("  -concurrent <readers> [-publish <m>] [-rate <updates/s>]\n");
+    printf("                                times reads against a live index while it is updated\n");
+    printf("  -dump <layerFile>             with <nbPoints>, writes the segments as a layer for -join\n");
+    printf("  -savecol <columnFile>         with <nbPoints>, writes the segments as a column file\n");
+    printf("options:\n");
+    printf("  -checkpoint <m> snapshots the sweep every m events (default %d)\n", checkpointEvery);
+    printf("  -active <auto | sorted | dense> keeps the active y-coordinates in a sorted tree or a bitmap\n");
+    printf("  -output <enumerate | compact | count | auto> prints and keeps the intersections of a batch run,\n");
+    printf("      keeps them, or counts them; auto chooses from an estimate, with at most -memory <MB> (default %d) kept\n",
+           (int)(outputMemory >> 20));
+    exit(1);
+}
+
+
 /* ****************************** */
 int main(int argc, char** argv) {
     
-    //read number of points from user
-    if (argc!=2) {
-        printf("usage: viewPoints <nbPoints>\n");
-        exit(1);
+    //read number of points, or the index to load, from user
+    const char* savePath = NULL;
+    const char* dumpPath = NULL;
+    const char* colPath = NULL;
+    const char* saveColPath = NULL;
+    int cx1 = INT_MIN, cx2 = INT_MAX;
+    const char* loadPath = NULL;
+    const char* daemonPath = NULL;
+    int nbReaders = 0;
+    int updatesPerPublish = 16;
+    int updatesPerSecond = 1000;
+    bool query = false;
+    int qx = 0, qy1 = 0, qy2 = 0;
+    bool window = false;
+    int wx1 = 0, wx2 = 0, wy1 = 0, wy2 = 0;
+    bool batch = false;
+    bool estimate = false;
+    bool kernels = false;
+    if (argc < 2) {
+        usage();
+    }
+    int a = 1;
+    if (strcmp(argv[1], "-join") == 0) {
+        //horizontals of one layer against verticals of another; nothing else applies
+        if (argc < 4) usage();
+        int nbThreads = max(1, (int)thread::hardware_concurrency());
+        const char* pairsPath = NULL;
+        for (a = 4; a < argc; a++) {
+            if (strcmp(argv[a], "-threads") == 0 && a + 1 < argc && atoi(argv[a + 1]) > 0) {
+                nbThreads = atoi(argv[++a]);
+            } else if (strcmp(argv[a], "-pairs") == 0 && a + 1 < argc) {
+                pairsPath = argv[++a];
+            } else {
+                usage();
+            }
+        }
+        return run_join(argv[2], argv[3], nbThreads, pairsPath) == 0 ? 0 : 1;
+    }
+    if (strcmp(argv[1], "-load") == 0) {
+        if (argc < 3) usage();
+        loadPath = argv[2];
+        a = 3;
+    } else if (strcmp(argv[1], "-col") == 0) {
+        if (argc < 3) usage();
+        colPath = argv[2];
+        a = 3;
+    } else {
+        n = atoi(argv[1]);
+        assert(n >0);
+        a = 2;
+    }
+    for (; a < argc; a++) {
+        if (strcmp(argv[a], "-save") == 0 && a + 1 < argc && !loadPath) {
+            savePath = argv[++a];
+        } else if (strcmp(argv[a], "-dump") == 0 && a + 1 < argc && !loadPath) {
+            dumpPath = argv[++a];
+        } else if (strcmp(argv[a], "-savecol") == 0 && a + 1 < argc && !loadPath && !colPath) {
+            saveColPath = argv[++a];
+        } else if (strcmp(argv[a], "-xrange") == 0 && a + 2 < argc && colPath) {
+            cx1 = atoi(argv[++a]);
+            cx2 = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "-query") == 0 && a + 3 < argc && loadPath) {
+            query = true;
+            qx = atoi(argv[++a]);
+            qy1 = atoi(argv[++a]);
+            qy2 = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "-window") == 0 && a + 4 < argc) {
+            window = true;
+            wx1 = atoi(argv[++a]);
+            wx2 = atoi(argv[++a]);
+            wy1 = atoi(argv[++a]);
+            wy2 = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "-daemon") == 0 && a + 1 < argc) {
+            daemonPath = argv[++a];
+        } else if (strcmp(argv[a], "-concurrent") == 0 && a + 1 < argc && atoi(argv[a + 1]) > 0) {
+            nbReaders = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "-publish") == 0 && a + 1 < argc && atoi(argv[a + 1]) > 0) {
+            updatesPerPublish = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "-rate") == 0 && a + 1 < argc && atoi(argv[a + 1]) > 0) {
+            updatesPerSecond = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "-batch") == 0) {
+            batch = true;
+        } else if (strcmp(argv[a], "-resume") == 0 && a + 1 < argc) {
+            resumePath = argv[++a];
+        } else if (strcmp(argv[a], "-active") == 0 && a + 1 < argc) {
+            a++;
+            if (strcmp(argv[a], "sorted") == 0) activeChoice = ACTIVE_SORTED;
+            else if (strcmp(argv[a], "dense") == 0) activeChoice = ACTIVE_DENSE;
+            else if (strcmp(argv[a], "auto") == 0) activeChoice = ACTIVE_AUTO;
+            else usage();
+        } else if (strcmp(argv[a], "-output") == 0 && a + 1 < argc) {
+            a++;
+            batchOutput = -1;
+            for (int o = 0; o < OUTPUT_AUTO; o++) {
+                if (strcmp(argv[a], outputNames[o]) == 0) batchOutput = o;
+            }
+            if (strcmp(argv[a], "auto") == 0) batchOutput = OUTPUT_AUTO;
+            if (batchOutput < 0) usage();
+        } else if (strcmp(argv[a], "-memory") == 0 && a + 1 < argc && atoi(argv[a + 1]) > 0) {
+            outputMemory = (size_t)atoi(argv[++a]) << 20;
+        } else if (strcmp(argv[a], "-kernels") == 0) {
+            kernels = true;
+        } else if (strcmp(argv[a], "-estimate") == 0) {
+            estimate = true;
+        } else if (strcmp(argv[a], "-checkpoint") == 0 && a + 1 < argc && atoi(argv[a + 1]) > 0) {
+            checkpointEvery = atoi(argv[++a]);
+        } else {
+            usage();
+        }
+    }
+    if (colPath) {
+        //the other modes need the segments in memory
+        if (loadPath || daemonPath || window || estimate || nbReaders || batch || kernels) usage();
+        init_phases();
+        return run_columns(colPath, cx1, cx2) == 0 ? 0 : 1;
+    }
+    if (!loadPath && !daemonPath && !window && !estimate && !dumpPath && !saveColPath && !nbReaders) {
+        printf("you entered n=%d\n", n);
     }
-    n = atoi(argv[1]);
-    printf("you entered n=%d\n", n);
-    assert(n >0);
     
-    initialize_segments_random();
-    print_segments();
-    creatEvents();
-    sortEvents();
+    init_phases();
+    if (loadPath) {
+        segIndex idx;
+        phase_start(PHASE_EVENTS);
+        if (si_load(&idx, loadPath) != 0) {
+            exit(1);
+        }
+        phase_stop(PHASE_EVENTS);
+        if (query) {
+            Rtimer rt;
+            char buf[256];
+            rt_zero(rt);
+            rt_start(rt);
+            query_index(&idx, qx, qy1, qy2);
+            rt_stop(rt);
+            printf("load %s query %s\n", rt_sprint_total(buf, phaseTimer[PHASE_EVENTS]), rt_sprint(buf + 128, rt));
+            si_close(&idx);
+            return 0;
+        }
+        if (window) {
+            wcData data;
+            if (idx.wc.nbNodes == 0) {
+                //an index saved without -window has no counter
+                printf("the index has no window counter, building one\n");
+                wc_build(&data, vector<event>(idx.events, idx.events + idx.nbEvents));
+                wc_view(&idx.wc, &data);
+            }
+            count_window(&idx.wc, wx1, wx2, wy1, wy2);
+            si_close(&idx);
+            return 0;
+        }
+        if (daemonPath) {
+            //the live index takes over the mapping
+            liveIndex lx;
+            if (lx_init(&lx, &idx, true) != 0) {
+                exit(1);
+            }
+            int r = run_daemon(&lx, daemonPath);
+            lx_close(&lx);
+            return r == 0 ? 0 : 1;
+        }
+        if (load_from_index(&idx) != 0) {
+            exit(1);
+        }
+        si_close(&idx);
+    } else if (estimate || nbReaders) {
+        initialize_segments_random();
+    } else {
+        phase_start(PHASE_INIT);
+        initialize_segments_random();
+        phase_stop(PHASE_INIT);
+        if (dumpPath) {
+            return ls_save(segments, dumpPath) == 0 ? 0 : 1;
+        }
+        if (saveColPath) {
+            size_t size = cs_save(segments, saveColPath, CS_BLOCK_SIZE);
+            if (size == 0) {
+                return 1;
+            }
+            printf("%d segments in %zu bytes, %.2f per segment\n", n, size, (double)size / n);
+            return 0;
+        }
+        if (daemonPath) {
+            liveIndex lx;
+            if (lx_init_segments(&lx, segments, true) != 0) {
+                exit(1);
+            }
+            int r = run_daemon(&lx, daemonPath);
+            lx_close(&lx);
+            return r == 0 ? 0 : 1;
+        }
+        if (!window && !batch && !kernels) {
+            print_segments();
+        }
+        phase_start(PHASE_EVENTS);
+        creatEvents();
+        sortEvents();
+        phase_stop(PHASE_EVENTS);
+        
+        if (savePath) {
+            //the index only carries a window counter if it is asked for
+            segIndex idx;
+            if (si_build(&idx, events, segments, NULL, window) != 0 || si_save(&idx, savePath) != 0) {
+                exit(1);
+            }
+            printf("saved index of %d events to %s\n", (int)idx.nbEvents, savePath);
+            if (window) {
+                count_window(&idx.wc, wx1, wx2, wy1, wy2);
+                si_close(&idx);
+                return 0;
+            }
+            si_close(&idx);
+        }
+        if (window) {
+            wcData data;
+            windowCounter wc;
+            wc_build(&data, events);
+            wc_view(&wc, &data);
+            count_window(&wc, wx1, wx2, wy1, wy2);
+            return 0;
+        }
+    }
+    
+    if (nbReaders) {
+        return run_concurrent_bench(segments, nbReaders, 2.0, updatesPerPublish, updatesPerSecond) == 0 ? 0 : 1;
+    }
+    if (estimate) {
+        Rtimer rt;
+        char buf[128];
+        kEstimate est;
+        rt_zero(rt);
+        rt_start(rt);
+        est_intersections(segments, EST_SAMPLES, EST_BUDGET, 1.96, 1, &est);
+        rt_stop(rt);
+        est_print(stdout, &est);
+        printf("estimate %s\n", rt_sprint(buf, rt));
+        return 0;
+    }
+    if (resumePath && !batch) {
+        usage();
+    }
+    if (batch) {
+        run_batch();
+        return 0;
+    }
+    if (kernels) {
+        run_kernel_bench();
+        return 0;
+    }
+    restart_sweep();
     
     
     /* initialize GLUT  */
@@ -298,6 +1138,7 @@ int main(int argc, char** argv) {
     /* register callback functions */
     glutDisplayFunc(display);
     glutKeyboardFunc(keypress);
+    glutMouseFunc(mouse);
     glutIdleFunc(timerfunc);
     
     /* init GL */
@@ -504,9 +1345,50 @@ void keypress(unsigned char key, int x, int y) {
             
         case 'i':
             initialize_segments();
+            events.clear();
+            creatEvents();
+            sortEvents();
+            restart_sweep();
             glutPostRedisplay();
             break;
+            
+        case 'p':
+            paused = !paused;
+            break;
+            
+        case 'r':
+            //rewind
+            jump_to(checkpoints.cps[0].sweepX);
+            paused = false;
+            glutPostRedisplay();
+            break;
+            
+        //scrub backwards and forwards one x or 50 at a time
+        case ',':
+        case '.':
+        case '<':
+        case '>':
+            paused = true;
+            jump_to(sweep_line_x + (key == ',' ? -1 : key == '.' ? 1 : key == '<' ? -50 : 50));
+            glutPostRedisplay();
+            break;
+    }
+}
+
+
+/* ****************************** */
+/* a left click moves the sweep line to the clicked x and stops it there */
+void mouse(int button, int state, int x, int y) {
+    if (button != GLUT_LEFT_BUTTON || state != GLUT_DOWN) {
+        return;
+    }
+    int width = glutGet(GLUT_WINDOW_WIDTH);
+    if (width <= 0) {
+        return;
     }
+    paused = true;
+    jump_to(x * WINDOWSIZE / width);
+    glutPostRedisplay();
 }
 
 
@@ -0,0 +1,213 @@
+#include "wincount.h"
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+
+using namespace std;
+
+
+/* Returns node i if it was created in the current version, whose
+   nodes start at fresh and are not part of any recorded version yet,
+   else a copy of it */
+static int64_t touchNode(vector<wcNode>& nodes, int64_t i, int64_t fresh) {
+    if (i >= fresh) return i;
+    wcNode n = nodes[i];
+    nodes.push_back(n);
+    return (int64_t)nodes.size() - 1;
+}
+
+
+/* Adds d active horizontals at leaf slot below node, which covers the
+   leaves [lo,hi] and has tags acc above it; returns the new node */
+static int64_t addActive(vector<wcNode>& nodes, int64_t node, int lo, int hi,
+                         int slot, int d, int64_t acc, int64_t fresh) {
+    int64_t n = touchNode(nodes, node, fresh);
+    nodes[n].sumC += d;
+    nodes[n].sumT -= d * acc;
+    if (lo < hi) {
+        int mid = (lo + hi) / 2;
+        acc += nodes[n].tag;
+        if (slot <= mid) {
+            int64_t c = addActive(nodes, nodes[n].left, lo, mid, slot, d, acc, fresh);
+            nodes[n].left = c;
+        } else {
+            int64_t c = addActive(nodes, nodes[n].right, mid + 1, hi, slot, d, acc, fresh);
+            nodes[n].right = c;
+        }
+    }
+    return n;
+}
+
+
+/* Adds a vertical covering the leaves [a,b] below node, which covers
+   [lo,hi]; returns the new node, and in covered the active horizontals
+   in [a,b] */
+static int64_t addVertical(vector<wcNode>& nodes, int64_t node, int lo, int hi,
+                           int a, int b, int64_t* covered, int64_t fresh) {
+    if (b < lo || hi < a) {
+        *covered = 0;
+        return node;
+    }
+    int64_t n = touchNode(nodes, node, fresh);
+    if (a <= lo && hi <= b) {
+        nodes[n].tag++;
+        nodes[n].sumT += nodes[n].sumC;
+        *covered = nodes[n].sumC;
+        return n;
+    }
+    int mid = (lo + hi) / 2;
+    int64_t cl, cr;
+    int64_t l = addVertical(nodes, nodes[n].left, lo, mid, a, b, &cl, fresh);
+    int64_t r = addVertical(nodes, nodes[n].right, mid + 1, hi, a, b, &cr, fresh);
+    nodes[n].left = l;
+    nodes[n].right = r;
+    nodes[n].sumT += cl + cr;
+    *covered = cl + cr;
+    return n;
+}
+
+
+/* Leaf of coordinate y, which must be in ys */
+static int pointSlot(const vector<int>& ys, int y) {
+    return 2 * (int)(lower_bound(ys.begin(), ys.end(), y) - ys.begin());
+}
+
+
+/* **************************************** */
+void wc_build(wcData* data, const vector<event>& events) {
+
+    data->ys.clear();
+    data->versionX.clear();
+    data->versionRoot.clear();
+    data->nodes.clear();
+
+    for (size_t i = 0; i < events.size(); i++) {
+        data->ys.push_back(events[i].segment.start.y);
+        data->ys.push_back(events[i].segment.end.y);
+    }
+    sort(data->ys.begin(), data->ys.end());
+    data->ys.erase(unique(data->ys.begin(), data->ys.end()), data->ys.end());
+    int hi = data->ys.empty() ? 0 : 2 * (int)data->ys.size() - 2;
+
+    //node 0 is the empty tree
+    wcNode empty;
+    memset(&empty, 0, sizeof(empty));
+    data->nodes.push_back(empty);
+
+    //the events of one x all update the same version, so a node is
+    //copied only the first time one of them reaches it
+    int64_t root = 0;
+    int64_t fresh = (int64_t)data->nodes.size();
+    for (size_t i = 0; i < events.size(); i++) {
+        const event& e = events[i];
+        const segment2D& s = e.segment;
+        if (e.eventType == 'S') {
+            root = addActive(data->nodes, root, 0, hi, pointSlot(data->ys, s.start.y), 1, 0, fresh);
+        } else if (e.eventType == 'E') {
+            root = addActive(data->nodes, root, 0, hi, pointSlot(data->ys, s.start.y), -1, 0, fresh);
+        } else {
+            int64_t covered;
+            root = addVertical(data->nodes, root, 0, hi,
+                               pointSlot(data->ys, min(s.start.y, s.end.y)),
+                               pointSlot(data->ys, max(s.start.y, s.end.y)), &covered, fresh);
+        }
+        //a version holds all the events at its x
+        if (i + 1 == events.size() || events[i + 1].eventXCoord != e.eventXCoord) {
+            data->versionX.push_back(e.eventXCoord);
+            data->versionRoot.push_back(root);
+            fresh = (int64_t)data->nodes.size();
+        }
+    }
+}
+
+
+/* **************************************** */
+void wc_view(windowCounter* wc, const wcData* data) {
+    wc->ys = data->ys.empty() ? NULL : &data->ys[0];
+    wc->nbYs = data->ys.size();
+    wc->versionX = data->versionX.empty() ? NULL : &data->versionX[0];
+    wc->versionRoot = data->versionRoot.empty() ? NULL : &data->versionRoot[0];
+    wc->nbVersions = data->versionX.size();
+    wc->nodes = &data->nodes[0];
+    wc->nbNodes = data->nodes.size();
+}
+
+
+/* 1 if node is a node of wc other than the empty one; the indices of a
+   mapped counter are not checked when it is loaded */
+static bool isNode(const windowCounter* wc, int64_t node) {
+    return node > 0 && (uint64_t)node < wc->nbNodes;
+}
+
+
+/* Sum of T over the leaves [a,b] below node, which covers [lo,hi] and
+   has tags acc above it */
+static int64_t sumT(const windowCounter* wc, int64_t node, int lo, int hi,
+                    int a, int b, int64_t acc) {
+    if (!isNode(wc, node) || b < lo || hi < a) return 0;
+    const wcNode& n = wc->nodes[node];
+    if (a <= lo && hi <= b) return n.sumT + acc * n.sumC;
+    int mid = (lo + hi) / 2;
+    acc += n.tag;
+    return sumT(wc, n.left, lo, mid, a, b, acc)
+        + sumT(wc, n.right, mid + 1, hi, a, b, acc);
+}
+
+
+/* Root of the last version with x < bound (strict) or x <= bound, or 0 */
+static int64_t versionBefore(const windowCounter* wc, int bound, bool strict) {
+    const int* v = strict ? lower_bound(wc->versionX, wc->versionX + wc->nbVersions, bound)
+                          : upper_bound(wc->versionX, wc->versionX + wc->nbVersions, bound);
+    if (v == wc->versionX) return 0;
+    return wc->versionRoot[v - wc->versionX - 1];
+}
+
+
+/* **************************************** */
+uint64_t wc_count(const windowCounter* wc, int x1, int x2, int y1, int y2) {
+    if (x1 > x2) swap(x1, x2);
+    if (y1 > y2) swap(y1, y2);
+    if (wc->nbYs == 0) return 0;
+
+    //the leaves of the coordinates in [y1,y2]; the gaps hold no horizontal
+    int j1 = lower_bound(wc->ys, wc->ys + wc->nbYs, y1) - wc->ys;
+    int j2 = (upper_bound(wc->ys, wc->ys + wc->nbYs, y2) - wc->ys) - 1;
+    if (j1 > j2) return 0;
+    int hi = 2 * (int)wc->nbYs - 2;
+
+    int64_t after = sumT(wc, versionBefore(wc, x2, false), 0, hi, 2 * j1, 2 * j2, 0);
+    int64_t before = sumT(wc, versionBefore(wc, x1, true), 0, hi, 2 * j1, 2 * j2, 0);
+    return after - before;
+}
+
+
+/* **************************************** */
+uint64_t wc_stab(const windowCounter* wc, int x, int y) {
+    if (wc->nbYs == 0) return 0;
+    int j = lower_bound(wc->ys, wc->ys + wc->nbYs, y) - wc->ys;
+    int slot;
+    if (j < (int)wc->nbYs && wc->ys[j] == y) {
+        slot = 2 * j;
+    } else if (j == 0 || j == (int)wc->nbYs) {
+        return 0;
+    } else {
+        slot = 2 * j - 1;
+    }
+
+    uint64_t p = 0;
+    int lo = 0, hi = 2 * (int)wc->nbYs - 2;
+    for (int64_t node = versionBefore(wc, x, false); isNode(wc, node); ) {
+        const wcNode& n = wc->nodes[node];
+        p += n.tag;
+        if (lo == hi) break;
+        int mid = (lo + hi) / 2;
+        if (slot <= mid) {
+            node = n.left;
+            hi = mid;
+        } else {
+            node = n.right;
+            lo = mid + 1;
+        }
+    }
+    return p;
+}
@@ -0,0 +1,91 @@
+#ifndef __wincount_h
+#define __wincount_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "geom.h"
+
+
+/* Counts the intersections inside a window [x1,x2] x [y1,y2] in
+   O(log n) without enumerating them.
+
+   The sweep is recorded in a persistent segment tree over y, with one
+   version per distinct event x. Version X holds, for every y, T(y) =
+   the number of intersections at height y with x <= X, so a window
+   count is T(x2) - T(x1-1) summed over [y1,y2].
+
+   T cannot be kept directly: a vertical adds C(y), the number of
+   active horizontals at y, to T(y) over its whole y-range, and C keeps
+   changing afterwards. Instead a vertical adds 1 to a tag on the
+   O(log n) nodes covering its range (tags are never pushed down), and
+   a node keeps
+
+   sumC = sum of C(y) over its range
+   sumT = sum of T(y) over its range, minus sumC times the tags of its
+          ancestors
+
+   A horizontal that starts at y adds 1 to sumC and subtracts the tags
+   above each node of its path from sumT, so that it has met no
+   vertical yet; when it ends it does the opposite and keeps what the
+   tags gave it in between.
+
+   The leaves are the distinct y-coordinates of all the segments and
+   the open gaps between them (leaf 2j is ys[j], leaf 2j+1 the gap
+   after it), so the tags also count the verticals that cover any y,
+   which wc_stab exposes.
+
+   The tree is flat and pointer-free (children are indices, 0 is the
+   shared empty node), so it can be stored in an index image and
+   mapped back. A version copies a node only the first time one of its
+   events changes it, so it takes O(n log n) nodes, and much fewer when
+   many events share an x. That is still tens of nodes per segment, so
+   the indices are 64-bit and an index only carries a counter when it
+   is asked for.
+ */
+
+typedef struct _wcNode {
+  int64_t left, right; /* children */
+  int tag; /* verticals covering the whole range of the node */
+  int sumC;
+  int64_t sumT;
+} wcNode;
+
+
+/* A window counter, as a view over arrays that live elsewhere */
+typedef struct _windowCounter {
+  const int* ys; /* distinct y-coordinates */
+  size_t nbYs;
+  const int* versionX; /* increasing x of each version */
+  const int64_t* versionRoot; /* root of each version */
+  size_t nbVersions;
+  const wcNode* nodes;
+  size_t nbNodes; /* 0 if there is no counter */
+} windowCounter;
+
+
+/* The arrays of a window counter being built */
+typedef struct _wcData {
+  std::vector<int> ys;
+  std::vector<int> versionX;
+  std::vector<int64_t> versionRoot;
+  std::vector<wcNode> nodes;
+} wcData;
+
+
+/* records the sweep over the sorted events */
+void wc_build(wcData* data, const std::vector<event>& events);
+
+/* points wc to the arrays of data */
+void wc_view(windowCounter* wc, const wcData* data);
+
+
+/* returns the number of intersections (x,y) with x1<=x<=x2 and y1<=y<=y2.
+   wc must hold a counter */
+uint64_t wc_count(const windowCounter* wc, int x1, int x2, int y1, int y2);
+
+/* returns the number of vertical segments with x-coordinate <= x that
+   contain height y */
+uint64_t wc_stab(const windowCounter* wc, int x, int y);
+
+#endif